@@ -0,0 +1,479 @@
+// Набор эталонных программ на Mython для отслеживания производительности интерпретатора.
+// Для каждой программы отдельно измеряются фазы лексического анализа, разбора,
+// компиляции в байткод и исполнения: время и число выделений памяти на операцию
+// и пиковый объём резидентной памяти.
+// Программа streaming длиной 256 МБ исполняется потоково, при этом проверяется,
+// что пиковая память не зависит от длины программы. Она исполняется около минуты,
+// поэтому запускается, только если указана явно.
+// parallel_lex сравнивает скорость разбиения на токены программы длиной 64 МБ
+// в разное число потоков.
+//
+// Запуск: mython_bench [подстрока имени программы]
+#include "../include/compiler.h"
+#include "../include/lexer.h"
+#include "../include/parse.h"
+#include "../include/process_memory_p.h"
+#include "../include/runtime.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace std;
+
+namespace {
+atomic<size_t> allocation_count{0};
+}  // namespace
+
+// Замены не встраиваются: иначе GCC видит free от указателя, полученного из operator new,
+// и предупреждает о несогласованных функциях выделения (-Wmismatched-new-delete)
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocation_count.fetch_add(1, memory_order_relaxed);
+    if (void* memory = malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, size_t /*size*/) noexcept {
+    free(memory);
+}
+
+namespace {
+
+// Программа и число операций, которые она выполняет при исполнении
+struct Workload {
+    string name;
+    string program;
+    size_t operations;
+};
+
+// Повторяет строку line count раз
+string Repeat(const string& line, size_t count) {
+    string result;
+    result.reserve(line.size() * count);
+    for (size_t i = 0; i < count; ++i) {
+        result += line;
+    }
+    return result;
+}
+
+constexpr size_t DEPTH = 200;
+constexpr size_t CALLS = 50;
+
+// Цепочки арифметических операций в рекурсивном методе
+Workload Arithmetics() {
+    const string program = R"(
+class Arith:
+  def run(n, acc):
+    if n > 0:
+      return self.run(n - 1, (acc * 3 + n * 7 - n / 2) / 3 + 1 - acc / 5)
+    return acc
+
+a = Arith()
+)"s + Repeat("x = a.run(" + to_string(DEPTH) + ", 1)\n", CALLS);
+    return {"arithmetics"s, program, DEPTH * CALLS};
+}
+
+// Вызов метода, объявленного в базовом классе глубокой иерархии
+Workload Dispatch() {
+    constexpr size_t HIERARCHY_DEPTH = 8;
+    string program = R"(
+class A0:
+  def value(n):
+    return n + 1
+
+  def name():
+    return 'A0'
+)"s;
+    for (size_t i = 1; i <= HIERARCHY_DEPTH; ++i) {
+        program += "\nclass A" + to_string(i) + "(A" + to_string(i - 1) + "):\n"
+                   "  def name():\n"
+                   "    return 'A" + to_string(i) + "'\n";
+    }
+    program += R"(
+class Driver:
+  def run(obj, n, acc):
+    if n > 0:
+      return self.run(obj, n - 1, obj.value(acc))
+    return acc
+
+d = Driver()
+o = A)"s + to_string(HIERARCHY_DEPTH) + "()\n" +
+               Repeat("x = d.run(o, " + to_string(DEPTH) + ", 0)\n", CALLS);
+    return {"dispatch"s, program, DEPTH * CALLS};
+}
+
+// Вывод объектов, преобразуемых в строку методом __str__
+Workload StrPrinting() {
+    const string program = R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def __str__():
+    return '(' + str(self.x) + ', ' + str(self.y) + ')'
+
+class Printer:
+  def run(p, n):
+    if n > 0:
+      print p, n, p
+      self.run(p, n - 1)
+
+p = Point(3, 4)
+printer = Printer()
+)"s + Repeat("printer.run(p, " + to_string(DEPTH) + ")\n", CALLS);
+    return {"str_printing"s, program, DEPTH * CALLS};
+}
+
+// Обход графа объектов с чтением и записью полей
+Workload Fields() {
+    constexpr size_t NODES = DEPTH;
+    string program = R"(
+class Node:
+  def __init__(value, next):
+    self.value = value
+    self.next = next
+    self.visits = 0
+
+class Walker:
+  def walk(node, n, acc):
+    if n > 0:
+      node.visits = node.visits + 1
+      return self.walk(node.next, n - 1, acc + node.value * node.visits)
+    return acc
+
+n0 = Node(0, None)
+)"s;
+    for (size_t i = 1; i < NODES; ++i) {
+        program += "n" + to_string(i) + " = Node(" + to_string(i) + ", n" + to_string(i - 1) +
+                   ")\n";
+    }
+    program += "w = Walker()\n"s +
+               Repeat("x = w.walk(n" + to_string(NODES - 1) + ", " + to_string(NODES - 1) +
+                          ", 0)\n",
+                      CALLS);
+    return {"fields"s, program, (NODES - 1) * CALLS};
+}
+
+// Конкатенация строк
+Workload Strings() {
+    const string program = R"(
+class Concat:
+  def run(s, n):
+    if n > 0:
+      return self.run(s + 'ab' + str(n), n - 1)
+    return s
+
+c = Concat()
+)"s + Repeat("x = c.run('', " + to_string(DEPTH) + ")\n", CALLS);
+    return {"strings"s, program, DEPTH * CALLS};
+}
+
+// Поток вывода, отбрасывающий данные
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+
+    streamsize xsputn(const char* /*s*/, streamsize n) override {
+        return n;
+    }
+};
+
+// Возвращает пиковый объём резидентной памяти процесса в килобайтах
+long PeakRssKb() {
+    if (const long peak = process_memory::StatusKb("VmHWM:"sv); peak >= 0) {
+        return peak;
+    }
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+struct Measurement {
+    double ns_per_op = 0;
+    double allocations_per_op = 0;
+    long peak_rss_kb = 0;
+};
+
+constexpr chrono::milliseconds MIN_DURATION{200};
+constexpr size_t MIN_REPETITIONS = 3;
+constexpr size_t MAX_REPETITIONS = 1000;
+
+// Многократно исполняет phase. prepare вызывается перед каждым повтором вне замера.
+// operations - число операций, выполняемых одним вызовом phase
+template <typename Prepare, typename Phase>
+Measurement Measure(size_t operations, Prepare prepare, Phase phase) {
+    process_memory::ResetPeak();
+    chrono::nanoseconds elapsed{0};
+    size_t allocations = 0;
+    size_t repetitions = 0;
+    while (repetitions < MAX_REPETITIONS
+           && (repetitions < MIN_REPETITIONS || elapsed < MIN_DURATION)) {
+        auto state = prepare();
+        const size_t allocations_before = allocation_count.load(memory_order_relaxed);
+        const auto start = chrono::steady_clock::now();
+        phase(state);
+        elapsed += chrono::steady_clock::now() - start;
+        allocations += allocation_count.load(memory_order_relaxed) - allocations_before;
+        ++repetitions;
+    }
+    const double total_operations = static_cast<double>(operations * repetitions);
+    return {static_cast<double>(elapsed.count()) / total_operations,
+            static_cast<double>(allocations) / total_operations, PeakRssKb()};
+}
+
+struct Nothing {};
+
+// Программа вместе с положениями её узлов, как её разбирает интерпретатор
+struct ParsedProgram {
+    parse::SourceMap locations;
+    unique_ptr<runtime::Executable> program;
+};
+
+size_t CountTokens(const string& program) {
+    parse::Lexer lexer(program);
+    size_t count = 1;
+    while (!lexer.CurrentToken().Is<parse::token_type::Eof>()) {
+        lexer.NextToken();
+        ++count;
+    }
+    return count;
+}
+
+void PrintHeader() {
+    cout << left << setw(14) << "workload" << setw(10) << "phase" << right << setw(8) << "op"
+         << setw(14) << "ns/op" << setw(14) << "allocs/op" << setw(16) << "peak RSS, KB"
+         << endl;
+}
+
+void PrintRow(const string& workload, const string& phase, const string& unit,
+              const Measurement& measurement) {
+    cout << left << setw(14) << workload << setw(10) << phase << right << setw(8) << unit
+         << fixed << setprecision(1) << setw(14) << measurement.ns_per_op << setprecision(2)
+         << setw(14) << measurement.allocations_per_op << setw(16) << measurement.peak_rss_kb
+         << endl;
+}
+
+// Фаза разбора включает лексический анализ: лексер выдаёт токены по требованию.
+// Поэтому время и выделения памяти разбора вычисляются как разность с фазой лексера
+void RunWorkload(const Workload& workload) {
+    const size_t tokens = CountTokens(workload.program);
+    auto no_state = [] {
+        return Nothing{};
+    };
+
+    const Measurement lexer = Measure(tokens, no_state, [&](Nothing) {
+        parse::Lexer lex(workload.program);
+        while (!lex.CurrentToken().Is<parse::token_type::Eof>()) {
+            lex.NextToken();
+        }
+    });
+    PrintRow(workload.name, "lexer"s, "token"s, lexer);
+
+    Measurement parser = Measure(tokens, no_state, [&](Nothing) {
+        parse::Lexer lex(workload.program);
+        parse::SourceMap locations;
+        auto program = ParseProgram(lex, locations);
+    });
+    parser.ns_per_op -= lexer.ns_per_op;
+    parser.allocations_per_op -= lexer.allocations_per_op;
+    PrintRow(workload.name, "parser"s, "token"s, parser);
+
+    auto parse = [&] {
+        parse::Lexer lex(workload.program);
+        ParsedProgram parsed;
+        parsed.program = ParseProgram(lex, parsed.locations);
+        return parsed;
+    };
+    const Measurement compiler = Measure(tokens, parse, [](ParsedProgram& parsed) {
+        auto compiled = vm::Compile(std::move(parsed.program), &parsed.locations);
+    });
+    PrintRow(workload.name, "compile"s, "token"s, compiler);
+
+    NullBuffer null_buffer;
+    ostream null_output(&null_buffer);
+    runtime::SimpleContext context{null_output};
+    ParsedProgram parsed = parse();
+    auto program = vm::Compile(std::move(parsed.program), &parsed.locations);
+    const Measurement execution = Measure(workload.operations, no_state, [&](Nothing) {
+        runtime::Closure closure;
+        program->Execute(closure, context);
+    });
+    PrintRow(workload.name, "execute"s, "iter"s, execution);
+}
+
+// Поток, выдающий prefix, а затем count раз строку line. Программа генерируется
+// по мере чтения и целиком в памяти не хранится
+class GeneratedProgram : public streambuf {
+public:
+    GeneratedProgram(string prefix, const string& line, size_t count)
+        : prefix_(std::move(prefix)), line_size_(line.size()), remaining_(count) {
+        lines_per_block_ = max<size_t>(1, BLOCK_SIZE / line.size());
+        block_ = Repeat(line, lines_per_block_);
+        setg(prefix_.data(), prefix_.data(), prefix_.data() + prefix_.size());
+    }
+
+protected:
+    int underflow() override {
+        if (remaining_ == 0) {
+            return traits_type::eof();
+        }
+        const size_t lines = min(lines_per_block_, remaining_);
+        remaining_ -= lines;
+        setg(block_.data(), block_.data(), block_.data() + lines * line_size_);
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    string prefix_;
+    string block_;
+    size_t line_size_;
+    size_t lines_per_block_ = 0;
+    size_t remaining_;
+};
+
+constexpr size_t STREAMING_PROGRAM_SIZE = 256 * 1024 * 1024;
+// Допустимый прирост пиковой памяти при потоковом исполнении программы любой длины
+constexpr long STREAMING_RSS_LIMIT_KB = 32 * 1024;
+
+// Исполняет в потоковом режиме длинную плоскую программу из присваиваний, print и создания
+// объектов: каждый новый объект записывает self в поле, а предыдущий становится недостижим.
+// Возвращает false, если пиковая память выросла больше, чем на STREAMING_RSS_LIMIT_KB
+bool RunStreaming() {
+    const string prefix = R"(
+class Counter:
+  def __init__():
+    self.n = 0
+    self.last = None
+
+  def add(k):
+    self.n = self.n + k
+    return self.n
+
+class Node:
+  def __init__(owner, value):
+    owner.last = self
+    self.value = value
+
+c = Counter()
+x = 0
+)"s;
+    const string lines =
+        "x = c.add(1) + x / 2\nprint 'x =', x\ns = 'abc' + str(x)\nnode = Node(c, x)\n"s;
+    const size_t count = STREAMING_PROGRAM_SIZE / lines.size();
+    constexpr size_t STATEMENTS_PER_LINES = 4;
+
+    NullBuffer null_buffer;
+    ostream null_output(&null_buffer);
+    runtime::SimpleContext context{null_output};
+    GeneratedProgram program(prefix, lines, count);
+    istream input(&program);
+
+    process_memory::ResetPeak();
+    const long rss_before = process_memory::StatusKb("VmRSS:"sv);
+    const size_t allocations_before = allocation_count.load(memory_order_relaxed);
+    const auto start = chrono::steady_clock::now();
+    parse::Lexer lexer(input);
+    runtime::Closure closure;
+    vm::ExecuteIncrementally(lexer, closure, context);
+    const chrono::nanoseconds elapsed = chrono::steady_clock::now() - start;
+
+    const size_t allocations = allocation_count.load(memory_order_relaxed) - allocations_before;
+    const auto statements = static_cast<double>(count * STATEMENTS_PER_LINES);
+    const Measurement measurement{static_cast<double>(elapsed.count()) / statements,
+                                  static_cast<double>(allocations) / statements, PeakRssKb()};
+    PrintRow("streaming"s, "execute"s, "stmt"s, measurement);
+
+    const long growth = measurement.peak_rss_kb - rss_before;
+    if (rss_before >= 0 && growth > STREAMING_RSS_LIMIT_KB) {
+        cerr << "streaming: "sv << STREAMING_PROGRAM_SIZE / (1024 * 1024)
+             << " MB program raised peak RSS by "sv << growth << " KB, limit is "sv
+             << STREAMING_RSS_LIMIT_KB << " KB"sv << endl;
+        return false;
+    }
+    return true;
+}
+
+constexpr size_t PARALLEL_LEXING_PROGRAM_SIZE = 64 * 1024 * 1024;
+
+// Разбивает на токены длинную программу из эталонных программ в разное число потоков
+// и сравнивает скорость с однопоточным TokenBuffer::Tokenize
+void RunParallelLexing(const vector<Workload>& workloads) {
+    string program;
+    while (program.size() < PARALLEL_LEXING_PROGRAM_SIZE) {
+        for (const auto& workload : workloads) {
+            program += workload.program;
+        }
+    }
+    const auto tokenize_seconds = [&program](size_t threads) {
+        chrono::duration<double> best = chrono::duration<double>::max();
+        for (int repetition = 0; repetition < 3; ++repetition) {
+            const auto start = chrono::steady_clock::now();
+            const auto tokens = threads == 1 ? parse::TokenBuffer::Tokenize(program)
+                                             : parse::TokenBuffer::TokenizeParallel(program, threads);
+            best = min<chrono::duration<double>>(best, chrono::steady_clock::now() - start);
+        }
+        return best.count();
+    };
+
+    vector<size_t> thread_counts = {1, 2, 4, 8};
+    const size_t cores = max(1U, thread::hardware_concurrency());
+    if (cores > thread_counts.back()) {
+        thread_counts.push_back(cores);
+    }
+    const double sequential = tokenize_seconds(1);
+    const auto megabytes = static_cast<double>(program.size()) / (1024 * 1024);
+    for (const size_t threads : thread_counts) {
+        const double seconds = threads == 1 ? sequential : tokenize_seconds(threads);
+        cout << left << setw(14) << "parallel_lex"s << setw(10) << "lexer"s << right << setw(8)
+             << threads << fixed << setprecision(1) << setw(14) << megabytes / seconds
+             << " MB/s  x"sv << setprecision(2) << sequential / seconds << " ("sv << cores
+             << " cores)"sv << endl;
+    }
+}
+
+}  // namespace
+
+int main(int argc, const char** argv) {
+    const string filter = argc > 1 ? argv[1] : ""s;
+    const vector<Workload> workloads = {Arithmetics(), Dispatch(), StrPrinting(), Fields(),
+                                        Strings()};
+
+    PrintHeader();
+    for (const auto& workload : workloads) {
+        if (workload.name.find(filter) == string::npos) {
+            continue;
+        }
+        try {
+            RunWorkload(workload);
+        } catch (const exception& e) {
+            cerr << workload.name << ": "sv << e.what() << endl;
+            return 1;
+        }
+    }
+    if ("parallel_lex"s.find(filter) != string::npos) {
+        RunParallelLexing(workloads);
+    }
+    if (!filter.empty() && "streaming"s.find(filter) != string::npos && !RunStreaming()) {
+        return 1;
+    }
+    return 0;
+}
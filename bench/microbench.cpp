@@ -0,0 +1,392 @@
+// Микробенчмарки отдельных механизмов интерпретатора.
+// Каждый замер сравнивает текущую реализацию с прежней, воспроизведённой здесь же
+#include "../include/char_scan.h"
+#include "../include/lexer.h"
+#include "../include/runtime.h"
+#include "../include/statement.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <unordered_map>
+
+using namespace std;
+using runtime::ObjectHolder;
+
+namespace {
+
+constexpr size_t ITERATIONS = 1'000'000;
+
+// Возвращает среднее время одного вызова operation в наносекундах
+template <typename Operation>
+double MeasureNs(Operation operation, size_t iterations = ITERATIONS) {
+    const auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        operation();
+    }
+    const chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / static_cast<double>(iterations);
+}
+
+void Report(const string& name, double before_ns, double after_ns) {
+    cout << left << setw(28) << name << right << fixed << setprecision(1)
+         << setw(10) << before_ns << " ns/op -> " << setw(8) << after_ns << " ns/op  (x"
+         << setprecision(2) << before_ns / after_ns << ')' << endl;
+}
+
+// Прежняя реализация return: значение метода передаётся исключением...
+class ThrowingReturn : public ast::Statement {
+public:
+    explicit ThrowingReturn(unique_ptr<ast::Statement> statement)
+        : statement_(std::move(statement)) {
+    }
+
+    ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override {
+        throw statement_->Execute(closure, context);
+    }
+
+private:
+    unique_ptr<ast::Statement> statement_;
+};
+
+// ...и перехватывается телом метода
+class CatchingMethodBody : public ast::Statement {
+public:
+    explicit CatchingMethodBody(unique_ptr<ast::Statement> body)
+        : body_(std::move(body)) {
+    }
+
+    ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override {
+        try {
+            body_->Execute(closure, context);
+            return ObjectHolder::None();
+        } catch (ObjectHolder& result) {
+            return result;
+        }
+    }
+
+private:
+    unique_ptr<ast::Statement> body_;
+};
+
+unique_ptr<ast::Statement> SelfValue() {
+    return make_unique<ast::VariableValue>(vector<string>{"self"s, "value"s});
+}
+
+// Геттер вида "def get(): return self.value", исполняемый обходом дерева
+void BenchmarkReturn() {
+    vector<runtime::Method> methods;
+    methods.push_back({"get_throw"s, {},
+                       make_unique<CatchingMethodBody>(
+                           make_unique<ast::Compound>(make_unique<ThrowingReturn>(SelfValue())))});
+    methods.push_back({"get"s, {},
+                       make_unique<ast::MethodBody>(
+                           make_unique<ast::Compound>(make_unique<ast::Return>(SelfValue())))});
+    runtime::Class cls{"Getter"s, std::move(methods), nullptr};
+    runtime::ClassInstance instance{cls};
+    instance.Fields()["value"s] = ObjectHolder::Own(runtime::Number(1));
+
+    runtime::DummyContext context;
+    int checksum = 0;
+    const double before = MeasureNs([&] {
+        checksum += instance.Call("get_throw"s, {}, context).TryAs<runtime::Number>()->GetValue();
+    });
+    const double after = MeasureNs([&] {
+        checksum += instance.Call("get"s, {}, context).TryAs<runtime::Number>()->GetValue();
+    });
+    if (checksum != 2 * static_cast<int>(ITERATIONS)) {
+        throw runtime_error("Return benchmark produced a wrong result"s);
+    }
+    Report("return (throw -> flow)"s, before, after);
+}
+
+// Прежние IsTrue, Equal и Less: тип значения определялся через dynamic_cast
+template <typename T>
+T* DynamicCast(const ObjectHolder& holder) {
+    return dynamic_cast<T*>(holder.Get());
+}
+
+bool DynamicIsTrue(const ObjectHolder& object) {
+    if (auto obj = DynamicCast<runtime::Bool>(object)) {
+        return obj->GetValue();
+    }
+    if (auto obj = DynamicCast<runtime::Number>(object)) {
+        return obj->GetValue() != 0;
+    }
+    if (auto obj = DynamicCast<runtime::String>(object)) {
+        return !(obj->GetValue().empty());
+    }
+    return false;
+}
+
+template <class BinaryPredicate>
+optional<bool> DynamicBaseCompare(const ObjectHolder& lhs, const ObjectHolder& rhs,
+                                  BinaryPredicate predicate) {
+    {
+        auto l = DynamicCast<runtime::Bool>(lhs), r = DynamicCast<runtime::Bool>(rhs);
+        if (l && r) {
+            return predicate(l->GetValue(), r->GetValue());
+        }
+    }
+    {
+        auto l = DynamicCast<runtime::Number>(lhs), r = DynamicCast<runtime::Number>(rhs);
+        if (l && r) {
+            return predicate(l->GetValue(), r->GetValue());
+        }
+    }
+    {
+        auto l = DynamicCast<runtime::String>(lhs), r = DynamicCast<runtime::String>(rhs);
+        if (l && r) {
+            return predicate(l->GetValue(), r->GetValue());
+        }
+    }
+    return nullopt;
+}
+
+bool DynamicEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, runtime::Context&) {
+    if (auto result = DynamicBaseCompare(lhs, rhs, equal_to())) {
+        return *result;
+    }
+    if (DynamicCast<runtime::ClassInstance>(lhs)) {
+        throw runtime_error("Not supported in benchmark"s);
+    }
+    return !lhs && !rhs;
+}
+
+bool DynamicLess(const ObjectHolder& lhs, const ObjectHolder& rhs, runtime::Context&) {
+    if (auto result = DynamicBaseCompare(lhs, rhs, less())) {
+        return *result;
+    }
+    throw runtime_error("Not supported in benchmark"s);
+}
+
+// Пары значений всех типов, которые сравниваются встроенными правилами
+vector<pair<ObjectHolder, ObjectHolder>> ComparableValues() {
+    vector<pair<ObjectHolder, ObjectHolder>> values;
+    for (int i = 0; i < 16; ++i) {
+        values.emplace_back(ObjectHolder::Own(runtime::Number(i)),
+                            ObjectHolder::Own(runtime::Number(i % 5)));
+        values.emplace_back(ObjectHolder::Own(runtime::String(to_string(i))),
+                            ObjectHolder::Own(runtime::String(to_string(i % 3))));
+        values.emplace_back(ObjectHolder::Own(runtime::Bool(i % 2 == 0)),
+                            ObjectHolder::Own(runtime::Bool(i % 3 == 0)));
+    }
+    return values;
+}
+
+template <typename Compare>
+int CountTrue(const vector<pair<ObjectHolder, ObjectHolder>>& values, Compare compare,
+              runtime::Context& context) {
+    int count = 0;
+    for (const auto& [lhs, rhs] : values) {
+        count += compare(lhs, rhs, context) ? 1 : 0;
+    }
+    return count;
+}
+
+// Время указывается на одну операцию
+void BenchmarkTypeDispatch() {
+    const auto values = ComparableValues();
+    const size_t iterations = ITERATIONS / values.size();
+    const double per_op = static_cast<double>(values.size());
+    runtime::DummyContext context;
+
+    auto compare_both = [&](auto before_fn, auto after_fn, const string& name) {
+        int before_count = 0, after_count = 0;
+        const double before = MeasureNs(
+            [&] { before_count += CountTrue(values, before_fn, context); }, iterations);
+        const double after = MeasureNs(
+            [&] { after_count += CountTrue(values, after_fn, context); }, iterations);
+        if (before_count != after_count) {
+            throw runtime_error(name + " benchmark produced different results"s);
+        }
+        Report(name, before / per_op, after / per_op);
+    };
+    compare_both(DynamicEqual, runtime::Equal, "Equal (dynamic_cast -> tag)"s);
+    compare_both(DynamicLess, runtime::Less, "Less (dynamic_cast -> tag)"s);
+    compare_both(
+        [](const ObjectHolder& lhs, const ObjectHolder&, runtime::Context&) {
+            return DynamicIsTrue(lhs);
+        },
+        [](const ObjectHolder& lhs, const ObjectHolder&, runtime::Context&) {
+            return runtime::IsTrue(lhs);
+        },
+        "IsTrue (dynamic_cast -> tag)"s);
+}
+
+// Прежнее распознавание ключевых слов: поиск строки в unordered_map
+const parse::Token* MapFindKeyword(const string& word) {
+    static const unordered_map<string, parse::Token> lexemes = {
+        {"class"s, parse::token_type::Class{}}, {"return"s, parse::token_type::Return{}},
+        {"if"s, parse::token_type::If{}},       {"else"s, parse::token_type::Else{}},
+        {"def"s, parse::token_type::Def{}},     {"print"s, parse::token_type::Print{}},
+        {"and"s, parse::token_type::And{}},     {"or"s, parse::token_type::Or{}},
+        {"not"s, parse::token_type::Not{}},     {"None"s, parse::token_type::None{}},
+        {"True"s, parse::token_type::True{}},   {"False"s, parse::token_type::False{}},
+    };
+    return lexemes.count(word) ? &lexemes.at(word) : nullptr;
+}
+
+// Фрагмент программы, в котором много ключевых слов, идентификаторов и операций сравнения
+const string LEXER_SAMPLE = R"(class Shape(Base):
+  def area_of_shape(other, scale):
+    if not other == None and self.width >= scale or self.height <= scale:
+      return self.width * self.height != other.width_value * other.height_value
+    else:
+      print 'area', True, False, self.width, self.height
+      return None
+)"s;
+
+// Прежние побайтовые сканеры лексера на основе <cctype>
+const char* ScalarSkipSpaces(const char* it, const char* end) {
+    return find_if(it, end, [](char ch) {
+        return ch != ' ';
+    });
+}
+
+const char* ScalarSkipName(const char* it, const char* end) {
+    return find_if(it, end, [](char ch) {
+        return !(isalnum(static_cast<unsigned char>(ch)) || ch == '_');
+    });
+}
+
+const char* ScalarFindNewline(const char* it, const char* end) {
+    return find(it, end, '\n');
+}
+
+// Проходит source так же, как лексер: пропускает пробелы, комментарии и имена целиком,
+// остальные символы по одному. Возвращает число пройденных участков
+template <typename SkipSpaces, typename SkipName, typename FindNewline>
+size_t ScanSource(string_view source, SkipSpaces skip_spaces, SkipName skip_name,
+                  FindNewline find_newline) {
+    size_t runs = 0;
+    const char* it = source.data();
+    const char* const end = source.data() + source.size();
+    while (it != end) {
+        const char ch = *it;
+        if (ch == ' ') {
+            it = skip_spaces(it, end);
+        } else if (ch == '#') {
+            it = find_newline(it, end);
+        } else if (parse::IsNameChar(ch)) {
+            it = skip_name(it + 1, end);
+        } else {
+            ++it;
+        }
+        ++runs;
+    }
+    return runs;
+}
+
+void ReportThroughput(const string& name, size_t bytes, double before_ns, double after_ns) {
+    const auto size = static_cast<double>(bytes);
+    cout << left << setw(28) << name << right << fixed << setprecision(2) << setw(10)
+         << size / before_ns << " GB/s -> " << setw(8) << size / after_ns << " GB/s  (x"
+         << before_ns / after_ns << ')' << endl;
+}
+
+// Скорость одного сканера на сплошном участке длиной в мегабайт
+template <typename Before, typename After>
+void BenchmarkScanner(const string& name, char fill, Before before_scan, After after_scan) {
+    const string run = string(1U << 20, fill) + "\x01"s;
+    const char* const end = run.data() + run.size();
+    // Иначе компилятор вынесет одинаковый вызов из цикла замера
+    const char* volatile begin = run.data();
+    size_t before_length = 0, after_length = 0;
+    const double before = MeasureNs([&] {
+        before_length += before_scan(begin, end) - run.data();
+    }, 200);
+    const double after = MeasureNs([&] {
+        after_length += after_scan(begin, end) - run.data();
+    }, 200);
+    if (before_length != after_length) {
+        throw runtime_error("Scanner benchmark produced different results"s);
+    }
+    ReportThroughput(name, run.size(), before, after);
+}
+
+// Скорость сканеров пробелов, комментариев и имён: на сгенерированной программе,
+// где участки короткие, и на длинных сплошных участках
+void BenchmarkLexerScan(const string& source) {
+    const auto find_newline = [](const char* it, const char* end) {
+        return parse::FindChar(it, end, '\n');
+    };
+    const size_t repetitions = 20;
+    size_t before_runs = 0, after_runs = 0;
+    const double before = MeasureNs([&] {
+        before_runs += ScanSource(source, ScalarSkipSpaces, ScalarSkipName, ScalarFindNewline);
+    }, repetitions);
+    const double after = MeasureNs([&] {
+        after_runs += ScanSource(source, parse::SkipSpaceRun, parse::SkipNameRun, find_newline);
+    }, repetitions);
+    if (before_runs != after_runs) {
+        throw runtime_error("Scanner benchmark produced different results"s);
+    }
+    ReportThroughput("Scan source (cctype -> SIMD)"s, source.size(), before, after);
+
+    BenchmarkScanner("Scan spaces"s, ' ', ScalarSkipSpaces, parse::SkipSpaceRun);
+    BenchmarkScanner("Scan name"s, 'x', ScalarSkipName, parse::SkipNameRun);
+    BenchmarkScanner("Scan comment"s, '#', ScalarFindNewline, find_newline);
+}
+
+// Распознавание ключевых слов на словах из LEXER_SAMPLE и пропускная способность лексера
+void BenchmarkLexer() {
+    vector<string> words;
+    istringstream sample(LEXER_SAMPLE);
+    for (string word; sample >> word;) {
+        if (isalpha(static_cast<unsigned char>(word.front()))) {
+            words.push_back(word);
+        }
+    }
+    size_t before_count = 0, after_count = 0;
+    const double before = MeasureNs([&] {
+        for (const string& word : words) {
+            // Прежний лексер строил std::string для каждого слова
+            before_count += MapFindKeyword(string(string_view(word))) != nullptr;
+        }
+    }, ITERATIONS / 10);
+    const double after = MeasureNs([&] {
+        for (const string& word : words) {
+            after_count += parse::FindKeyword(word) != nullptr;
+        }
+    }, ITERATIONS / 10);
+    if (before_count != after_count) {
+        throw runtime_error("Keyword benchmark produced different results"s);
+    }
+    const auto per_word = static_cast<double>(words.size());
+    Report("Keyword lookup (map -> perfect hash)"s, before / per_word, after / per_word);
+
+    // Сгенерированная программа: LEXER_SAMPLE вперемешку со строками комментариев
+    string source;
+    while (source.size() < (1U << 22)) {
+        source += LEXER_SAMPLE;
+        source += "# shapes are compared by area, the base class provides width and height\n"s;
+    }
+    BenchmarkLexerScan(source);
+
+    size_t tokens = 0;
+    const size_t repetitions = 10;
+    const double ns = MeasureNs([&] {
+        parse::Lexer lexer(source);
+        while (!lexer.CurrentToken().Is<parse::token_type::Eof>()) {
+            lexer.NextToken();
+            ++tokens;
+        }
+    }, repetitions);
+    cout << left << setw(28) << "Lexer throughput"s << right << fixed << setprecision(1)
+         << setw(10) << static_cast<double>(source.size()) * 1000.0 / ns << " MB/s, "
+         << ns / static_cast<double>(tokens / repetitions) << " ns/token" << endl;
+}
+
+}  // namespace
+
+int main() {
+    BenchmarkReturn();
+    BenchmarkTypeDispatch();
+    BenchmarkLexer();
+    return 0;
+}
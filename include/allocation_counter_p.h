@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+// Подсчёт выделений динамической памяти для модульных тестов.
+// Глобальный operator new подменяется, только когда тесты собираются (NDEBUG не определён)
+namespace allocation_counter {
+
+// Возвращает число вызовов operator new с момента запуска программы
+std::size_t Count();
+
+// Возвращает число выделений памяти, выполненных при вызове func
+template <typename Func>
+std::size_t CountAllocations(Func&& func) {
+    const std::size_t before = Count();
+    func();
+    return Count() - before;
+}
+
+}  // namespace allocation_counter
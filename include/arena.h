@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace runtime {
+
+// Нужно ли арене вызывать деструктор объекта типа T при своём разрушении.
+// Типы, которые владеют только памятью в той же арене, специализируют значение как false
+template <typename T>
+inline constexpr bool ARENA_NEEDS_CLEANUP = !std::is_trivially_destructible_v<T>;
+
+/*
+ * Арена: объекты размещаются подряд в крупных блоках и освобождаются все сразу
+ * при разрушении арены, а не по одному. Деструкторы объектов, которым они нужны,
+ * вызываются в порядке, обратном созданию, простым проходом по списку, без обхода
+ * ссылок между объектами
+ */
+class Arena {
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        for (auto it = cleanups_.rbegin(); it != cleanups_.rend(); ++it) {
+            it->destroy(it->object);
+        }
+    }
+
+    // Создаёт в арене объект типа T
+    template <typename T, typename... Args>
+    T* Make(Args&&... args) {
+        void* memory = Allocate(sizeof(T), alignof(T));
+        T* object = new (memory) T(std::forward<Args>(args)...);
+        if constexpr (ARENA_NEEDS_CLEANUP<T>) {
+            cleanups_.push_back(Cleanup{object, [](void* pointer) {
+                                            static_cast<T*>(pointer)->~T();
+                                        }});
+        }
+        return object;
+    }
+
+    // Объём памяти, полученной ареной у системы
+    [[nodiscard]] size_t GetReservedBytes() const {
+        return reserved_;
+    }
+
+private:
+    static constexpr size_t FIRST_BLOCK_SIZE = 1024;
+    static constexpr size_t MAX_BLOCK_SIZE = 64 * 1024;
+
+    void* Allocate(size_t size, size_t alignment) {
+        const size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(current_) % alignment)
+                               % alignment;
+        if (current_ == nullptr || static_cast<size_t>(end_ - current_) < padding + size) {
+            AddBlock(size + alignment);
+            return Allocate(size, alignment);
+        }
+        void* result = current_ + padding;
+        current_ += padding + size;
+        return result;
+    }
+
+    // Каждый следующий блок вдвое больше предыдущего, пока не достигнет MAX_BLOCK_SIZE
+    void AddBlock(size_t min_size) {
+        const size_t previous = blocks_.empty() ? FIRST_BLOCK_SIZE / 2 : block_size_;
+        block_size_ = std::max(std::min(previous * 2, MAX_BLOCK_SIZE), min_size);
+        // Память блока не обнуляется: её всё равно заполнят конструкторы объектов
+        blocks_.emplace_back(new std::byte[block_size_]);
+        current_ = blocks_.back().get();
+        end_ = current_ + block_size_;
+        reserved_ += block_size_;
+    }
+
+    struct Cleanup {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    std::byte* current_ = nullptr;
+    std::byte* end_ = nullptr;
+    size_t block_size_ = 0;
+    size_t reserved_ = 0;
+    std::vector<Cleanup> cleanups_;
+};
+
+}  // namespace runtime
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace parse {
+
+/*
+ * Классификация символов и поиск концов однородных участков строки для лексера.
+ * Классы символов берутся из таблицы, а не из <cctype>, поэтому не зависят от локали.
+ * Сканеры проверяют по 32 (AVX2) или 16 (SSE2) байт за раз; без SIMD,
+ * а также на хвосте строки короче регистра, используется побайтовый цикл по таблице.
+ * Набор инструкций выбирается при сборке: AVX2 - только с опцией CMake MYTHON_ENABLE_AVX2
+ */
+
+enum CharClass : std::uint8_t {
+    CHAR_SPACE = 1,  // ' '
+    CHAR_DIGIT = 2,  // '0'..'9'
+    CHAR_NAME = 4,   // буквы латинского алфавита, цифры и '_'
+    CHAR_STRING_PLAIN = 8,  // символы строковой константы, кроме кавычек, '\\' и концов строк
+};
+
+inline constexpr std::array<std::uint8_t, 256> CHAR_CLASSES = [] {
+    std::array<std::uint8_t, 256> classes{};
+    for (auto& char_class : classes) {
+        char_class = CHAR_STRING_PLAIN;
+    }
+    for (const char ch : {'"', '\'', '\\', '\n', '\r'}) {
+        classes[static_cast<unsigned char>(ch)] = 0;
+    }
+    classes[static_cast<unsigned char>(' ')] |= CHAR_SPACE;
+    for (char ch = '0'; ch <= '9'; ++ch) {
+        classes[static_cast<unsigned char>(ch)] |= CHAR_DIGIT | CHAR_NAME;
+    }
+    for (char ch = 'a'; ch <= 'z'; ++ch) {
+        classes[static_cast<unsigned char>(ch)] |= CHAR_NAME;
+        classes[static_cast<unsigned char>(ch - 'a' + 'A')] |= CHAR_NAME;
+    }
+    classes[static_cast<unsigned char>('_')] |= CHAR_NAME;
+    return classes;
+}();
+
+inline bool HasClass(char ch, CharClass char_class) {
+    return (CHAR_CLASSES[static_cast<unsigned char>(ch)] & char_class) != 0;
+}
+
+inline bool IsDigit(char ch) {
+    return HasClass(ch, CHAR_DIGIT);
+}
+
+// Символ, допустимый в имени
+inline bool IsNameChar(char ch) {
+    return HasClass(ch, CHAR_NAME);
+}
+
+namespace scan_detail {
+
+// Побайтовый поиск первого символа из [it, end), не принадлежащего классу char_class
+inline const char* SkipClassScalar(const char* it, const char* end, CharClass char_class) {
+    while (it != end && HasClass(*it, char_class)) {
+        ++it;
+    }
+    return it;
+}
+
+#if defined(__AVX2__)
+inline constexpr int VECTOR_SIZE = 32;
+using Vector = __m256i;
+using Mask = std::uint32_t;
+
+inline Vector Load(const char* it) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+}
+
+inline Vector Splat(char ch) {
+    return _mm256_set1_epi8(ch);
+}
+
+inline Vector Equal(Vector lhs, Vector rhs) {
+    return _mm256_cmpeq_epi8(lhs, rhs);
+}
+
+// Байты из [lo, hi]. Сравнение знаковое, поэтому байты не из ASCII в диапазон не попадают
+inline Vector InRange(Vector bytes, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(bytes, Splat(static_cast<char>(lo - 1))),
+                            _mm256_cmpgt_epi8(Splat(static_cast<char>(hi + 1)), bytes));
+}
+
+inline Vector Or(Vector lhs, Vector rhs) {
+    return _mm256_or_si256(lhs, rhs);
+}
+
+inline Mask ToMask(Vector bytes) {
+    return static_cast<Mask>(_mm256_movemask_epi8(bytes));
+}
+
+inline Vector ToLower(Vector bytes) {
+    return _mm256_or_si256(bytes, Splat(0x20));
+}
+#elif defined(__SSE2__)
+inline constexpr int VECTOR_SIZE = 16;
+using Vector = __m128i;
+using Mask = std::uint32_t;
+
+inline Vector Load(const char* it) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+}
+
+inline Vector Splat(char ch) {
+    return _mm_set1_epi8(ch);
+}
+
+inline Vector Equal(Vector lhs, Vector rhs) {
+    return _mm_cmpeq_epi8(lhs, rhs);
+}
+
+// Байты из [lo, hi]. Сравнение знаковое, поэтому байты не из ASCII в диапазон не попадают
+inline Vector InRange(Vector bytes, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(bytes, Splat(static_cast<char>(lo - 1))),
+                         _mm_cmpgt_epi8(Splat(static_cast<char>(hi + 1)), bytes));
+}
+
+inline Vector Or(Vector lhs, Vector rhs) {
+    return _mm_or_si128(lhs, rhs);
+}
+
+inline Mask ToMask(Vector bytes) {
+    return static_cast<Mask>(_mm_movemask_epi8(bytes));
+}
+
+inline Vector ToLower(Vector bytes) {
+    return _mm_or_si128(bytes, Splat(0x20));
+}
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+inline constexpr Mask FULL_MASK = static_cast<Mask>((std::uint64_t{1} << VECTOR_SIZE) - 1);
+
+// Пропускает символы, для которых matches(блок) выставляет биты маски
+template <typename Matches>
+const char* SkipVector(const char* it, const char* end, CharClass char_class, Matches matches) {
+    while (end - it >= VECTOR_SIZE) {
+        const Mask mask = matches(Load(it));
+        if (mask != FULL_MASK) {
+            return it + __builtin_ctz(~mask);
+        }
+        it += VECTOR_SIZE;
+    }
+    return SkipClassScalar(it, end, char_class);
+}
+#endif
+
+}  // namespace scan_detail
+
+// Возвращает указатель на первый символ из [it, end), отличный от пробела
+inline const char* SkipSpaceRun(const char* it, const char* end) {
+    // Чаще всего пробелов нет или он один, и до регистров дело не доходит
+    if (it == end || *it != ' ') {
+        return it;
+    }
+#if defined(__AVX2__) || defined(__SSE2__)
+    using namespace scan_detail;
+    return SkipVector(it, end, CHAR_SPACE, [](Vector bytes) {
+        return ToMask(Equal(bytes, Splat(' ')));
+    });
+#else
+    return scan_detail::SkipClassScalar(it, end, CHAR_SPACE);
+#endif
+}
+
+// Возвращает указатель на первый символ из [it, end), который не может входить в имя
+inline const char* SkipNameRun(const char* it, const char* end) {
+#if defined(__AVX2__) || defined(__SSE2__)
+    using namespace scan_detail;
+    return SkipVector(it, end, CHAR_NAME, [](Vector bytes) {
+        const Vector letters = InRange(ToLower(bytes), 'a', 'z');
+        const Vector digits = InRange(bytes, '0', '9');
+        return ToMask(Or(Or(letters, digits), Equal(bytes, Splat('_'))));
+    });
+#else
+    return scan_detail::SkipClassScalar(it, end, CHAR_NAME);
+#endif
+}
+
+// Возвращает указатель на первый символ из [it, end), не являющийся цифрой
+inline const char* SkipDigitRun(const char* it, const char* end) {
+#if defined(__AVX2__) || defined(__SSE2__)
+    using namespace scan_detail;
+    return SkipVector(it, end, CHAR_DIGIT, [](Vector bytes) {
+        return ToMask(InRange(bytes, '0', '9'));
+    });
+#else
+    return scan_detail::SkipClassScalar(it, end, CHAR_DIGIT);
+#endif
+}
+
+// Возвращает указатель на первую кавычку, '\\', '\n' или '\r' из [it, end) либо end
+inline const char* SkipStringRun(const char* it, const char* end) {
+#if defined(__AVX2__) || defined(__SSE2__)
+    using namespace scan_detail;
+    return SkipVector(it, end, CHAR_STRING_PLAIN, [](Vector bytes) {
+        const Vector quotes = Or(Equal(bytes, Splat('"')), Equal(bytes, Splat('\'')));
+        const Vector line_ends = Or(Equal(bytes, Splat('\n')), Equal(bytes, Splat('\r')));
+        return ~ToMask(Or(Or(quotes, line_ends), Equal(bytes, Splat('\\')))) & FULL_MASK;
+    });
+#else
+    return scan_detail::SkipClassScalar(it, end, CHAR_STRING_PLAIN);
+#endif
+}
+
+// Возвращает указатель на первое вхождение ch в [it, end) либо end.
+// memchr стандартной библиотеки уже векторизован и работает с выровненными блоками
+inline const char* FindChar(const char* it, const char* end, char ch) {
+    if (it == end) {
+        return end;
+    }
+    const void* found = std::memchr(it, ch, end - it);
+    return found != nullptr ? static_cast<const char*>(found) : end;
+}
+
+}  // namespace parse
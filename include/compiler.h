@@ -0,0 +1,32 @@
+#pragma once
+
+#include "parse.h"
+#include "vm.h"
+
+#include <memory>
+
+namespace vm {
+
+/*
+ * Компилирует программу, построенную ParseProgram, в байткод регистровой машины.
+ * Тела методов всех объявленных в программе классов компилируются на месте,
+ * поэтому ClassInstance::Call также исполняет байткод.
+ * Возвращаемый объект владеет исходным AST.
+ * Если задана таблица locations, построенная ParseProgram, инструкции получают
+ * положения узлов, из которых скомпилированы.
+ */
+std::unique_ptr<runtime::Executable> Compile(std::unique_ptr<runtime::Executable> program,
+                                             const parse::SourceMap* locations = nullptr);
+
+/*
+ * Исполняет программу по мере разбора: каждая инструкция верхнего уровня компилируется,
+ * исполняется и сразу освобождается вместе со своим деревом. Поэтому расход памяти
+ * определяется самой большой инструкцией или определением класса, а не длиной программы.
+ * Переменные программы хранятся в closure.
+ * В отличие от Compile, ошибка разбора обнаруживается только после исполнения
+ * предшествующих ей инструкций
+ */
+void ExecuteIncrementally(parse::Lexer& lexer, runtime::Closure& closure,
+                          runtime::Context& context);
+
+}  // namespace vm
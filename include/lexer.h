@@ -1,14 +1,20 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <iosfwd>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <variant>
-#include <unordered_map>
+#include <vector>
 #include <functional>
 
+#include "source_location.h"
+#include "symbol.h"
+
 namespace parse {
 
     namespace token_type {
@@ -16,8 +22,8 @@ namespace parse {
             int value;   // число
         };
 
-        struct Id {             // Лексема «идентификатор»
-            std::string value;  // Имя идентификатора
+        struct Id {                 // Лексема «идентификатор»
+            runtime::Symbol value;  // Имя идентификатора
         };
 
         struct Char {    // Лексема «символ»
@@ -85,48 +91,187 @@ namespace parse {
     class LexerError : public std::runtime_error {
     public:
         using std::runtime_error::runtime_error;
-    };
 
-    static const std::unordered_map<std::string, parse::Token> lexemes = {
-            {"class",   parse::token_type::Class{}},
-            {"return",  parse::token_type::Return{}},
-            {"if",      parse::token_type::If{}},
-            {"else",    parse::token_type::Else{}},
-            {"def",     parse::token_type::Def{}},
-            {"print",   parse::token_type::Print{}},
-            {"and",     parse::token_type::And{}},
-            {"or",      parse::token_type::Or{}},
-            {"not",     parse::token_type::Not{}},
-            {"==",  parse::token_type::Eq{}},
-            {"!=",  parse::token_type::NotEq{}},
-            {"<=",  parse::token_type::LessOrEq{}},
-            {">=",  parse::token_type::GreaterOrEq{}},
-            {"None",    parse::token_type::None{}},
-            {"True",    parse::token_type::True{}},
-            {"False",   parse::token_type::False{}}
+        LexerError(const std::string& message, SourceLocation location)
+            : std::runtime_error(WithLocation(message, location)), location_(location) {
+        }
+
+        [[nodiscard]] SourceLocation GetLocation() const {
+            return location_;
+        }
+
+    private:
+        SourceLocation location_;
     };
 
+    // Возвращает токен ключевого слова word либо nullptr, если word не является ключевым словом
+    [[nodiscard]] const Token* FindKeyword(std::string_view word);
+
     inline constexpr char COMMENT_SIGN = '#';
     inline constexpr char SPACE_SIGN = ' ';
     inline constexpr char NEW_LINE_SIGN = '\n';
 
+    // Вид токена. Порядок совпадает с порядком альтернатив TokenBase
+    enum class TokenKind : std::uint8_t {
+        Number, Id, Char, String, Class, Return, If, Else, Def, Newline, Print, Indent,
+        Dedent, And, Or, Not, Eq, NotEq, LessOrEq, GreaterOrEq, None, True, False, Eof
+    };
+
+    static_assert(static_cast<size_t>(TokenKind::Eof) + 1 == std::variant_size_v<TokenBase>);
+
+    // Компактное представление токена: вид, положение в исходном тексте и значение
+    struct CompactToken {
+        // Смещение первого символа лексемы от начала программы и длина лексемы
+        std::uint32_t offset = 0;
+        std::uint32_t length = 0;
+        // Number - значение, Char - код символа,
+        // Id и String - номер в таблице имён или строковых констант TokenBuffer
+        std::int32_t value = 0;
+        TokenKind kind = TokenKind::Eof;
+    };
+
+    /*
+     * Токены программы в виде плоского массива компактных токенов.
+     * Имена и строковые константы хранятся в отдельных таблицах, на которые ссылаются токены
+     */
+    class TokenBuffer {
+    public:
+        // Разбивает на токены всю программу source за один проход.
+        // Для получения текста лексем буфер source должен оставаться жив, пока жив TokenBuffer
+        static TokenBuffer Tokenize(std::string_view source);
+
+        // То же, что Tokenize, но в thread_count потоков. Программа делится на части по границам
+        // строк, части разбираются независимо, а токены отступов на стыках исправляются при
+        // слиянии. При thread_count == 0 число потоков выбирается по числу ядер и длине программы
+        static TokenBuffer TokenizeParallel(std::string_view source, size_t thread_count = 0);
+
+        // Наименьшая часть программы, ради которой TokenizeParallel заводит отдельный поток
+        static constexpr size_t PARALLEL_CHUNK_SIZE = 1 << 20;
+
+        [[nodiscard]] size_t Size() const { return tokens_.size(); }
+
+        [[nodiscard]] const CompactToken& operator[](size_t index) const { return tokens_[index]; }
+
+        // Возвращает полное представление токена с номером index
+        [[nodiscard]] Token ToToken(size_t index) const;
+
+        // Имя идентификатора token
+        [[nodiscard]] runtime::Symbol GetId(const CompactToken& token) const {
+            return ids_[token.value];
+        }
+
+        // Значение строковой константы token
+        [[nodiscard]] const std::string& GetString(const CompactToken& token) const {
+            return strings_[token.value];
+        }
+
+        // Текст лексемы token в исходной программе. Доступен, только если буфер создан Tokenize
+        [[nodiscard]] std::string_view GetText(const CompactToken& token) const {
+            return source_.substr(token.offset, token.length);
+        }
+
+        // Строка и столбец начала лексемы token. Вычисляются по таблице начал строк,
+        // поэтому сами токены не хранят положение
+        [[nodiscard]] SourceLocation GetLocation(const CompactToken& token) const;
+
+        void Clear();
+
+    private:
+        friend class LineTokenizer;
+
+        // Смещение начала строки программы, содержащей токены, и её номер
+        struct LineStart {
+            std::uint32_t offset = 0;
+            std::uint32_t line = 0;
+        };
+
+        std::string_view source_;
+        std::vector<CompactToken> tokens_;
+        std::vector<LineStart> lines_;
+        std::vector<runtime::Symbol> ids_;
+        std::vector<std::string> strings_;
+    };
+
+    // Разбивает программу на токены по одной строке, вставляя токены изменения отступа.
+    // Методы разбора получают непрочитанный остаток строки и отбрасывают из него
+    // разобранные символы
+    class LineTokenizer {
+    public:
+        // first_line - номер первой разбираемой строки в программе
+        explicit LineTokenizer(std::uint32_t first_line = 1): line_number_(first_line - 1) {
+        }
+
+        // Дописывает в buffer токены строки line, которая начинается со смещения offset
+        // и включает завершающий '\n'. Пустая line означает конец программы.
+        // Возвращает false, если строка не содержит токенов и пропущена
+        bool ParseLine(std::string_view line, size_t offset, TokenBuffer& buffer);
+
+        // Отступ последней строки с токенами
+        [[nodiscard]] int CurrentIndent() const { return current_indent_; }
+
+    private:
+        void Add(TokenKind kind, std::string_view lexeme, std::int32_t value = 0);
+
+        // Ошибка разбора символа position текущей строки
+        [[nodiscard]] LexerError Error(const char* position, const std::string& message) const;
+
+        static int SkipSpaces(std::string_view &input);
+
+        static void SkipComment(std::string_view &input);
+
+        void ParseString(std::string_view &input, TokenBuffer& buffer);
+
+        void ParseNumber(std::string_view &input);
+
+        void ParseNameOrToken(std::string_view &input, TokenBuffer& buffer);
+
+        void ParseComparisonOrChar(std::string_view &input);
+
+        // Символ для имени name. Недавно встречавшиеся имена берутся из кеша
+        // без обращения к общей таблице символов
+        runtime::Symbol InternName(std::string_view name);
+
+        // Начало разбираемой строки и её смещение от начала программы
+        const char* line_begin_ = nullptr;
+        size_t line_offset_ = 0;
+        // Номер разбираемой строки, смещение её начала и завершается ли она '\n'
+        std::uint32_t line_number_ = 0;
+        size_t line_start_ = 0;
+        bool line_terminated_ = true;
+        int current_indent_ = 0;
+        std::vector<CompactToken> line_tokens_;
+        std::array<runtime::Symbol, 256> recent_names_;
+    };
 
     class Lexer {
     public:
+        // Читает программу из потока по одной строке
         explicit Lexer(std::istream& input);
 
+        // Разбирает программу, целиком находящуюся в памяти, по одной строке без копирования.
+        // Буфер source должен оставаться жив, пока жив лексер
+        explicit Lexer(std::string_view source);
+
+        // Перебирает токены, заранее полученные TokenBuffer::Tokenize
+        explicit Lexer(TokenBuffer tokens);
+
         // Возвращает ссылку на текущий токен или token_type::Eof, если поток токенов закончился
         [[nodiscard]] const Token &CurrentToken() const;
 
         // Возвращает следующий токен, либо token_type::Eof, если поток токенов закончился
         Token NextToken();
 
+        // Возвращает положение текущего токена в программе
+        [[nodiscard]] SourceLocation CurrentLocation() const;
+
         // Если текущий токен имеет тип T, метод возвращает ссылку на него.
         // В противном случае метод выбрасывает исключение LexerError
         template<typename T>
         const T &Expect() const {
             using namespace std::literals;
-            if (!CurrentToken().Is<T>()) { throw LexerError("Not the expected type of the current token"s); }
+            if (!CurrentToken().Is<T>()) {
+                throw LexerError("Not the expected type of the current token"s, CurrentLocation());
+            }
             return CurrentToken().As<T>();
         }
 
@@ -136,7 +281,8 @@ namespace parse {
         void Expect(const U &value) const {
             using namespace std::literals;
             if (!CurrentToken().Is<T>() || CurrentToken().As<T>().value != value) {
-                throw LexerError("Not the expected type of the current token or value"s);
+                throw LexerError("Not the expected type of the current token or value"s,
+                                 CurrentLocation());
             }
         }
 
@@ -159,36 +305,25 @@ namespace parse {
         }
 
     private:
-        void ParseTokens(std::istream& input);
-
-        struct LineTokenizer {
-            static Lexer::LineTokenizer ReadLine(std::istream &input);
-
-            static int SkipSpaces(std::istream &input);
-
-            static void SkipComment(std::istream &input);
-
-            static token_type::String ParseString(std::istream &input);
-
-            static token_type::Number ParseNumber(std::istream &input);
-
-            void ParseNameOrToken(std::istream &input);
-
-            void ParseComparisonOrChar(std::istream &input);
-
-            [[nodiscard]] bool IsEmpty() const;
-
-            [[nodiscard]] bool IsEofOnly() const;
-
-            void Reset();
-
-            int indent_ = 0;
-            std::vector<Token> tokens_;
-        } tokinazer_;
-
-        std::istream& input_;
-        int current_indent_ = 0;
-        int index_current_token_ = -1;
+        // Возвращает очередную строку программы вместе с завершающим её '\n'.
+        // Пустая строка означает, что программа закончилась
+        std::string_view NextLine();
+
+        // Заменяет содержимое tokens_ токенами очередной непустой строки
+        void ParseTokens();
+
+        LineTokenizer tokenizer_;
+        // Токены текущей строки либо, если batch_, всей программы
+        TokenBuffer tokens_;
+        bool batch_ = false;
+        size_t index_current_token_ = 0;
+        Token current_token_ = token_type::Eof{};
+
+        // Источник строк: поток, если он задан, иначе непрочитанная часть source_
+        std::istream* input_ = nullptr;
+        std::string line_buffer_;
+        std::string_view source_;
+        size_t offset_ = 0;
     };
 
 }  // namespace parse
\ No newline at end of file
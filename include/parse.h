@@ -1,18 +1,86 @@
 #pragma once
 
+#include "source_location.h"
+
 #include <memory>
 #include <stdexcept>
-
-namespace parse {
-class Lexer;
-}
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace runtime {
 class Executable;
 }
 
+namespace parse {
+class Lexer;
+
+/*
+ * Положения узлов AST в тексте программы. Таблица хранится отдельно от дерева,
+ * чтобы не увеличивать размер узлов, которые обходятся при исполнении.
+ * Используется для сообщений об ошибках и для сопоставления узлов со строками программы.
+ * Записи добавляются в конец без поиска, упорядочиваются при первом обращении
+ */
+class SourceMap {
+public:
+    // Каждый узел добавляется не более одного раза
+    void Add(const runtime::Executable* node, SourceLocation location) {
+        entries_.push_back({node, location});
+        sorted_ = false;
+    }
+
+    // Положение узла node либо неизвестное положение, если узел не записан в таблицу
+    [[nodiscard]] SourceLocation Find(const runtime::Executable* node) const;
+
+    [[nodiscard]] size_t Size() const {
+        return entries_.size();
+    }
+
+    void Clear() {
+        entries_.clear();
+        sorted_ = true;
+    }
+
+private:
+    using Entry = std::pair<const runtime::Executable*, SourceLocation>;
+
+    mutable std::vector<Entry> entries_;
+    mutable bool sorted_ = true;
+};
+}  // namespace parse
+
 struct ParseError : std::runtime_error {
     using std::runtime_error::runtime_error;
+
+    ParseError(const std::string& message, parse::SourceLocation location)
+        : std::runtime_error(parse::WithLocation(message, location)), location(location) {
+    }
+
+    parse::SourceLocation location;
 };
 
-std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
\ No newline at end of file
+std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
+
+// Разбирает программу, записывая в locations положения построенных узлов
+std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer, parse::SourceMap& locations);
+
+/*
+ * Разбирает программу по одной инструкции верхнего уровня, чтобы её можно было исполнять
+ * по мере чтения, не строя дерево всей программы. Объявленные классы запоминаются
+ * между инструкциями
+ */
+class IncrementalParser {
+public:
+    explicit IncrementalParser(parse::Lexer& lexer, parse::SourceMap* locations = nullptr);
+    ~IncrementalParser();
+
+    // Возвращает очередную инструкцию верхнего уровня либо nullptr, если программа закончилась
+    std::unique_ptr<runtime::Executable> ParseStatement();
+
+private:
+    struct DeclaredClasses;
+
+    parse::Lexer& lexer_;
+    parse::SourceMap* locations_;
+    std::unique_ptr<DeclaredClasses> declared_classes_;
+};
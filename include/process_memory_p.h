@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#ifdef __linux__
+#include <fstream>
+#endif
+
+// Резидентная память процесса по данным /proc/self. Используется модульными тестами
+// и бенчмарками; в других системах значения недоступны
+namespace process_memory {
+
+// Сбрасывает пиковый объём резидентной памяти процесса (VmHWM), если система это поддерживает
+inline void ResetPeak() {
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+// Возвращает значение поля field из /proc/self/status в килобайтах либо -1
+inline long StatusKb([[maybe_unused]] std::string_view field) {
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, field.size(), field) == 0) {
+            return std::stol(line.substr(field.size()));
+        }
+    }
+#endif
+    return -1;
+}
+
+}  // namespace process_memory
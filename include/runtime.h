@@ -1,12 +1,22 @@
 #pragma once
 
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <new>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 #include <optional>
 
+#include "arena.h"
+#include "symbol.h"
+
 namespace runtime {
 
 // Контекст исполнения инструкций Mython
@@ -19,33 +29,125 @@ protected:
     ~Context() = default;
 };
 
+// Тип объекта. Позволяет определять тип значения без RTTI
+enum class ObjectType : unsigned char {
+    // Значение None, используется только в ObjectHolder::GetType
+    None,
+    Number,
+    String,
+    Bool,
+    Class,
+    ClassInstance,
+    // Прочие наследники Object
+    Other,
+};
+
 // Базовый класс для всех объектов языка Mython
 class Object {
 public:
     virtual ~Object() = default;
     // выводит в os своё представление в виде строки
     virtual void Print(std::ostream& os, Context& context) = 0;
+
+    // Возвращает тип, заданный при создании объекта
+    [[nodiscard]] ObjectType GetType() const { return type_; }
+
+protected:
+    Object() = default;
+    explicit Object(ObjectType type) : type_(type) {}
+    // Копия объекта не принадлежит ObjectHolder, даже если оригинал ему принадлежит
+    Object(const Object& other) : type_(other.type_) {}
+    Object& operator=(const Object& other) {
+        type_ = other.type_;
+        return *this;
+    }
+
+private:
+    friend class ObjectHolder;
+
+    ObjectType type_ = ObjectType::Other;
+    // Объект создан ObjectHolder::Own в куче и живёт, пока на него есть владеющие ссылки
+    bool owned_ = false;
 };
 
-// Специальный класс-обёртка, предназначенный для хранения объекта в Mython-программе
+template <typename T>
+class ValueObject;
+class Bool;
+class Class;
+class ClassInstance;
+
+// Числовое значение
+using Number = ValueObject<int>;
+// Строковое значение
+using String = ValueObject<std::string>;
+
+// Тип объекта, соответствующий классу T. Для классов, не имеющих
+// собственного ObjectType, known = false
+template <typename T>
+struct ObjectTypeOf {
+    static constexpr bool known = false;
+};
+
+#define MYTHON_OBJECT_TYPE(type_name, tag)                  \
+    template <>                                             \
+    struct ObjectTypeOf<type_name> {                        \
+        static constexpr bool known = true;                 \
+        static constexpr ObjectType value = ObjectType::tag; \
+    };
+MYTHON_OBJECT_TYPE(Number, Number)
+MYTHON_OBJECT_TYPE(String, String)
+MYTHON_OBJECT_TYPE(Bool, Bool)
+MYTHON_OBJECT_TYPE(Class, Class)
+MYTHON_OBJECT_TYPE(ClassInstance, ClassInstance)
+#undef MYTHON_OBJECT_TYPE
+
+/*
+ * Специальный класс-обёртка, предназначенный для хранения объекта в Mython-программе.
+ * Значения Number и Bool хранятся внутри обёртки, без обращения к куче,
+ * остальные объекты - в куче вместе со счётчиком владеющих ссылок.
+ * Не владеющая обёртка хранит только указатель на объект
+ */
 class ObjectHolder {
 public:
     // Создаёт пустое значение
     ObjectHolder() = default;
 
+    ObjectHolder(const ObjectHolder& other);
+    ObjectHolder(ObjectHolder&& other) noexcept;
+    ObjectHolder& operator=(const ObjectHolder& other);
+    ObjectHolder& operator=(ObjectHolder&& other) noexcept;
+    ~ObjectHolder();
+
     // Возвращает ObjectHolder, владеющий объектом типа T
     // Тип T - конкретный класс-наследник Object.
-    // object копируется или перемещается в кучу
+    // Number и Bool копируются внутрь ObjectHolder, остальные объекты - в кучу
     template <typename T>
     [[nodiscard]] static ObjectHolder Own(T&& object) {
-        return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
+        using Type = std::decay_t<T>;
+        ObjectHolder holder;
+        if constexpr (std::is_same_v<Type, Number> || std::is_same_v<Type, Bool>) {
+            new (holder.storage_) Type(std::forward<T>(object));
+        } else {
+            holder.SetPointer(Allocate<Type>(std::forward<T>(object)), OWNED);
+        }
+        return holder;
     }
 
-    // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки)
+    // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки).
+    // Не выделяет память
     [[nodiscard]] static ObjectHolder Share(Object& object);
     // Создаёт пустой ObjectHolder, соответствующий значению None
     [[nodiscard]] static ObjectHolder None();
 
+    // Делает владеющей ссылку, созданную Share, если она указывает на объект, созданный Own.
+    // Вызывается перед записью значения в поле объекта или в таблицу символов: self
+    // не владеет объектом, а записанное значение может пережить все владеющие ссылки
+    void Retain() {
+        if (!IsInline() && (Word(1) & OWNED) == 0) {
+            RetainBorrowed();
+        }
+    }
+
     // Возвращает ссылку на Object внутри ObjectHolder.
     // ObjectHolder должен быть непустым
     Object& operator*() const;
@@ -55,28 +157,116 @@ public:
     [[nodiscard]] Object* Get() const;
 
     // Возвращает указатель на объект типа T либо nullptr, если внутри ObjectHolder не хранится
-    // объект данного типа
+    // объект данного типа. Для типов значений Mython проверяется только тип объекта
     template <typename T>
     [[nodiscard]] T* TryAs() const {
-        return dynamic_cast<T*>(this->Get());
+        if constexpr (ObjectTypeOf<T>::known) {
+            return GetType() == ObjectTypeOf<T>::value ? static_cast<T*>(Get()) : nullptr;
+        } else {
+            return dynamic_cast<T*>(Get());
+        }
+    }
+
+    // Возвращает тип хранимого объекта либо ObjectType::None
+    [[nodiscard]] ObjectType GetType() const {
+        if (IsInline()) {
+            return InlineObject()->GetType();
+        }
+        const Object* object = Pointer();
+        return object ? object->GetType() : ObjectType::None;
     }
 
     // Возвращает true, если ObjectHolder не пуст
     explicit operator bool() const;
 
+    // Размер места под значение, хранящееся внутри ObjectHolder
+    static constexpr size_t INLINE_SIZE = 2 * sizeof(void*);
+
 private:
-    explicit ObjectHolder(std::shared_ptr<Object> data);
+    // Заголовок объекта, созданного Own в куче. Объекты Mython используются одним потоком,
+    // поэтому счётчик ссылок не атомарный
+    struct alignas(std::max_align_t) HeapHeader {
+        size_t references;
+    };
+
+    // Признак владеющей ссылки в младшем бите указателя на объект
+    static constexpr std::uintptr_t OWNED = 1;
+
+    // Размещает объект в куче сразу за заголовком с единственной владеющей ссылкой
+    template <typename Type, typename T>
+    static Object* Allocate(T&& object) {
+        static_assert(alignof(Type) <= alignof(HeapHeader));
+        void* memory = ::operator new(sizeof(HeapHeader) + sizeof(Type));
+        auto* header = new (memory) HeapHeader{1};
+        Object* result;
+        try {
+            result = new (header + 1) Type(std::forward<T>(object));
+        } catch (...) {
+            ::operator delete(memory);
+            throw;
+        }
+        // HeaderOf ищет заголовок перед Object, поэтому Object - первая база Type
+        assert(static_cast<void*>(result) == static_cast<void*>(header + 1));
+        result->owned_ = true;
+        return result;
+    }
+
+    static HeapHeader* HeaderOf(Object* object) {
+        return std::launder(reinterpret_cast<HeapHeader*>(object) - 1);
+    }
+
+    // Уничтожает объект в куче, на который не осталось владеющих ссылок
+    static void Destroy(Object* object) noexcept;
+
     void AssertIsValid() const;
+    void RetainBorrowed();
 
-    std::shared_ptr<Object> data_;
+    [[nodiscard]] std::uintptr_t Word(size_t index) const {
+        std::uintptr_t word;
+        std::memcpy(&word, storage_ + index * sizeof(word), sizeof(word));
+        return word;
+    }
+
+    void SetPointer(Object* object, std::uintptr_t flags) {
+        const std::uintptr_t words[] = {0, reinterpret_cast<std::uintptr_t>(object) | flags};
+        std::memcpy(storage_, words, sizeof(words));
+    }
+
+    // В начале Number и Bool лежит указатель на таблицу виртуальных функций, он не равен нулю
+    [[nodiscard]] bool IsInline() const {
+        return Word(0) != 0;
+    }
+
+    [[nodiscard]] Object* InlineObject() const {
+        return std::launder(reinterpret_cast<Object*>(storage_));
+    }
+
+    // Указатель на объект вне storage_ либо nullptr для None
+    [[nodiscard]] Object* Pointer() const {
+        return reinterpret_cast<Object*>(Word(1) & ~OWNED);
+    }
+
+    // Копирует или переносит значение other в пустой ObjectHolder
+    void CopyFrom(const ObjectHolder& other);
+    void MoveFrom(ObjectHolder& other) noexcept;
+    // Делает ObjectHolder пустым
+    void Reset() noexcept;
+
+    // Number или Bool целиком либо нулевое слово и указатель на объект с признаком OWNED.
+    // Оба слова пустого ObjectHolder равны нулю
+    alignas(void*) mutable unsigned char storage_[INLINE_SIZE] = {};
 };
 
+static_assert(sizeof(ObjectHolder) <= 16);
+
 // Объект-значение, хранящий значение типа T
 template <typename T>
 class ValueObject : public Object {
 public:
     ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-        : value_(v) {
+        : Object(ObjectTypeOf<ValueObject>::known ? ObjectTypeOf<ValueObject>::value
+                                                  : ObjectType::Other),
+          value_(v) {
     }
 
     void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
@@ -87,17 +277,113 @@ public:
         return value_;
     }
 
+protected:
+    ValueObject(T v, ObjectType type)
+        : Object(type), value_(v) {
+    }
+
 private:
     T value_;
 };
 
 // Таблица символов, связывающая имя объекта с его значением
-using Closure = std::unordered_map<std::string, ObjectHolder>;
+using Closure = std::unordered_map<Symbol, ObjectHolder>;
 
 // Проверяет, содержится ли в object значение, приводимое к True
 // Для отличных от нуля чисел, True и непустых строк возвращается true. В остальных случаях - false.
 bool IsTrue(const ObjectHolder& object);
 
+// Границы диапазона целых чисел, строковые представления которых создаются заранее
+constexpr int SMALL_INT_STRING_MIN = -256;
+constexpr int SMALL_INT_STRING_MAX = 1024;
+
+// Возвращает строку, в которую выводится object, как объект String.
+// Для None, True, False и чисел из [SMALL_INT_STRING_MIN, SMALL_INT_STRING_MAX] возвращается
+// ссылка на неизменяемую строку, созданную один раз на всю программу, и память не выделяется
+ObjectHolder Stringify(const ObjectHolder& object, Context& context);
+
+/*
+ * Стек кадров вызова потока. Память выделяется сегментами, которые никогда не перемещаются,
+ * поэтому указатель на слоты кадра остаётся действительным во время вложенных вызовов.
+ * Сегменты не освобождаются, и вызовы любой глубины после разогрева не выделяют память
+ */
+class FrameStack {
+public:
+    // Стек кадров текущего потока
+    static FrameStack& ThisThread() {
+        thread_local FrameStack stack;
+        return stack;
+    }
+
+    ObjectHolder* Acquire(size_t count) {
+        if (current_ < segments_.size()) {
+            Segment& segment = segments_[current_];
+            if (segment.top + count <= segment.size) {
+                ObjectHolder* slots = segment.data.get() + segment.top;
+                segment.top += count;
+                return slots;
+            }
+        }
+        return AcquireSlow(count);
+    }
+
+    // Освобождает слоты последнего кадра, обнуляя хранящиеся в них ссылки
+    void Release(ObjectHolder* slots, size_t count);
+
+private:
+    static constexpr size_t SEGMENT_SIZE = 4096;
+
+    struct Segment {
+        explicit Segment(size_t capacity)
+            : data(std::make_unique<ObjectHolder[]>(capacity)), size(capacity) {
+        }
+
+        std::unique_ptr<ObjectHolder[]> data;
+        size_t size = 0;
+        size_t top = 0;
+    };
+
+    ObjectHolder* AcquireSlow(size_t count);
+
+    std::vector<Segment> segments_;
+    size_t current_ = 0;
+};
+
+// Кадр вызова: count слотов на стеке кадров потока. Слоты возвращаются в стек при
+// разрушении кадра, в том числе по исключению
+class CallFrame {
+public:
+    explicit CallFrame(size_t count)
+        : count_(count) {
+        if (count_ > 0) {
+            slots_ = FrameStack::ThisThread().Acquire(count_);
+        }
+    }
+
+    CallFrame(const CallFrame&) = delete;
+    CallFrame& operator=(const CallFrame&) = delete;
+
+    ~CallFrame() {
+        if (count_ > 0) {
+            FrameStack::ThisThread().Release(slots_, count_);
+        }
+    }
+
+    [[nodiscard]] ObjectHolder* Slots() const {
+        return slots_;
+    }
+
+    ObjectHolder& operator[](size_t index) const {
+        return slots_[index];
+    }
+
+private:
+    size_t count_;
+    ObjectHolder* slots_ = nullptr;
+};
+
+struct Method;
+
 // Интерфейс для выполнения действий над объектами Mython
 class Executable {
 public:
@@ -105,55 +391,403 @@ public:
     // Выполняет действие над объектами внутри closure, используя context
     // Возвращает результирующее значение либо None
     virtual ObjectHolder Execute(Closure& closure, Context& context) = 0;
+
+    // Исполняет тело метода method. frame[0] содержит self, следующие слоты - значения
+    // параметров в порядке method.formal_params. Значения слотов можно переносить.
+    // По умолчанию кадр переносится в Closure и вызывается Execute
+    virtual ObjectHolder Call(const Method& method, ObjectHolder* frame, Context& context);
 };
 
-// Строковое значение
-using String = ValueObject<std::string>;
-// Числовое значение
-using Number = ValueObject<int>;
+// Удаляет объект Executable. Объекты, размещённые в арене, не удаляются по одному:
+// их освобождает сама арена
+class ExecutableDeleter {
+public:
+    ExecutableDeleter() = default;
+
+    // Позволяет передать std::unique_ptr, созданный std::make_unique, там, где ожидается
+    // ExecutablePtr
+    template <typename T>
+    ExecutableDeleter(  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        std::default_delete<T> /*deleter*/) noexcept {
+    }
+
+    // Удалитель объекта, которым владеет арена
+    static ExecutableDeleter InArena() {
+        ExecutableDeleter deleter;
+        deleter.owning_ = false;
+        return deleter;
+    }
+
+    void operator()(Executable* executable) const {
+        if (owning_) {
+            delete executable;
+        }
+    }
+
+private:
+    bool owning_ = true;
+};
+
+using ExecutablePtr = std::unique_ptr<Executable, ExecutableDeleter>;
 
 // Логическое значение
 class Bool : public ValueObject<bool> {
 public:
-    using ValueObject<bool>::ValueObject;
+    Bool(bool v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : ValueObject<bool>(v, ObjectType::Bool) {
+    }
 
     void Print(std::ostream& os, Context& context) override;
 };
 
+static_assert(sizeof(Number) <= ObjectHolder::INLINE_SIZE && sizeof(Bool) <= ObjectHolder::INLINE_SIZE);
+static_assert(alignof(Number) <= alignof(void*) && alignof(Bool) <= alignof(void*));
+static_assert(alignof(Object) > 1, "младший бит указателя на объект занят признаком владения");
+
+inline ObjectHolder::ObjectHolder(const ObjectHolder& other) {
+    CopyFrom(other);
+}
+
+inline ObjectHolder::ObjectHolder(ObjectHolder&& other) noexcept {
+    MoveFrom(other);
+}
+
+inline ObjectHolder& ObjectHolder::operator=(const ObjectHolder& other) {
+    if (this != &other) {
+        ObjectHolder copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+inline ObjectHolder& ObjectHolder::operator=(ObjectHolder&& other) noexcept {
+    if (this != &other) {
+        // Прежнее значение уничтожается последним: other может принадлежать ему
+        ObjectHolder old(std::move(*this));
+        MoveFrom(other);
+    }
+    return *this;
+}
+
+inline ObjectHolder::~ObjectHolder() {
+    Reset();
+}
+
+inline void ObjectHolder::CopyFrom(const ObjectHolder& other) {
+    if (other.IsInline()) {
+        const Object& object = *other.InlineObject();
+        if (object.GetType() == ObjectType::Number) {
+            new (storage_) Number(static_cast<const Number&>(object));
+        } else {
+            new (storage_) Bool(static_cast<const Bool&>(object));
+        }
+        return;
+    }
+    std::memcpy(storage_, other.storage_, INLINE_SIZE);
+    if ((Word(1) & OWNED) != 0) {
+        ++HeaderOf(Pointer())->references;
+    }
+}
+
+inline void ObjectHolder::MoveFrom(ObjectHolder& other) noexcept {
+    if (other.IsInline()) {
+        CopyFrom(other);
+    } else {
+        std::memcpy(storage_, other.storage_, INLINE_SIZE);
+    }
+    other.SetPointer(nullptr, 0);
+}
+
+inline void ObjectHolder::Reset() noexcept {
+    // Number и Bool не владеют ресурсами, их деструкторы можно не вызывать
+    Object* owned = !IsInline() && (Word(1) & OWNED) != 0 ? Pointer() : nullptr;
+    SetPointer(nullptr, 0);
+    if (owned != nullptr && --HeaderOf(owned)->references == 0) {
+        Destroy(owned);
+    }
+}
+
+inline ObjectHolder ObjectHolder::Share(Object& object) {
+    ObjectHolder holder;
+    holder.SetPointer(&object, 0);
+    return holder;
+}
+
+inline Object* ObjectHolder::Get() const {
+    return IsInline() ? InlineObject() : Pointer();
+}
+
+inline ObjectHolder::operator bool() const {
+    return Word(0) != 0 || Word(1) != 0;
+}
+
 // Метод класса
 struct Method {
     // Имя метода
-    std::string name;
+    Symbol name;
     // Имена формальных параметров метода
-    std::vector<std::string> formal_params;
+    std::vector<Symbol> formal_params;
     // Тело метода
-    std::unique_ptr<Executable> body;
+    ExecutablePtr body;
+    // Число слотов кадра вызова: self и параметры. Задаётся при создании класса
+    size_t frame_size = 0;
+};
+
+/*
+ * Форма (скрытый класс) объекта: список имён полей в порядке их добавления.
+ * Объекты одного класса, получившие одинаковые поля в одинаковом порядке, разделяют форму,
+ * а значения полей хранят в массиве по смещениям, которые задаёт форма.
+ * Формы образуют дерево переходов, корень которого принадлежит классу
+ */
+class Shape {
+public:
+    static constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+
+    Shape() = default;
+
+    Shape(Shape&&) = default;
+    Shape& operator=(Shape&&) = default;
+
+    // Возвращает смещение поля name либо NOT_FOUND
+    [[nodiscard]] size_t Find(Symbol name) const;
+
+    // Возвращает форму, получающуюся добавлением поля name в конец. Переход создаётся один раз
+    [[nodiscard]] const Shape* WithField(Symbol name) const;
+
+    // Возвращает количество полей
+    [[nodiscard]] inline size_t Size() const { return names_.size(); }
+
+    // Возвращает имя поля, расположенного по смещению offset
+    [[nodiscard]] inline Symbol GetFieldName(size_t offset) const {
+        return names_[offset];
+    }
+
+private:
+    Shape(const Shape& parent, Symbol name);
+
+    std::vector<Symbol> names_;
+    std::unordered_map<Symbol, size_t> offsets_;
+    mutable std::unordered_map<Symbol, std::unique_ptr<Shape>> transitions_;
+};
+
+// Кеш места обращения к полю: смещение поля в последней встреченной форме объекта.
+// Каждый кеш используется только с одним именем поля
+struct FieldCache {
+    const Shape* shape = nullptr;
+    // Если не nullptr, в shape поля нет и запись добавляет его, переводя объект в эту форму
+    const Shape* transition = nullptr;
+    size_t offset = 0;
+};
+
+/*
+ * Поля объекта: форма и массив значений.
+ * Помимо доступа через кеш, поддерживает интерфейс Closure для обращения по имени
+ */
+class FieldTable {
+    template <typename Table, typename Value>
+    class Iterator {
+    public:
+        using value_type = std::pair<Symbol, Value&>;
+
+        // Позволяет писать it->second, хотя элементы таблицы не хранятся парами
+        struct Pointer {
+            value_type entry;
+            const value_type* operator->() const { return &entry; }
+        };
+
+        Iterator(Table* table, size_t index) : table_(table), index_(index) {}
+
+        value_type operator*() const {
+            return {table_->shape_->GetFieldName(index_), table_->values_[index_]};
+        }
+        Pointer operator->() const { return {**this}; }
+
+        Iterator& operator++() {
+            ++index_;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const { return index_ == other.index_; }
+        bool operator!=(const Iterator& other) const { return index_ != other.index_; }
+
+    private:
+        Table* table_;
+        size_t index_;
+    };
+
+public:
+    using iterator = Iterator<FieldTable, ObjectHolder>;
+    using const_iterator = Iterator<const FieldTable, const ObjectHolder>;
+
+    explicit FieldTable(const Shape& shape) : shape_(&shape) {}
+
+    // Возвращает указатель на значение поля name либо nullptr, если поля нет
+    [[nodiscard]] ObjectHolder* Find(Symbol name, FieldCache& cache);
+    // Возвращает ссылку на значение поля name, при необходимости добавляя поле
+    [[nodiscard]] ObjectHolder& Emplace(Symbol name, FieldCache& cache);
+
+    [[nodiscard]] inline const Shape& GetShape() const { return *shape_; }
+
+    [[nodiscard]] iterator find(Symbol name);
+    [[nodiscard]] const_iterator find(Symbol name) const;
+    [[nodiscard]] iterator begin() { return {this, 0}; }
+    [[nodiscard]] iterator end() { return {this, values_.size()}; }
+    [[nodiscard]] const_iterator begin() const { return {this, 0}; }
+    [[nodiscard]] const_iterator end() const { return {this, values_.size()}; }
+    [[nodiscard]] size_t count(Symbol name) const;
+    [[nodiscard]] size_t size() const { return values_.size(); }
+    [[nodiscard]] bool empty() const { return values_.empty(); }
+    // Выбрасывает std::out_of_range, если поля нет
+    [[nodiscard]] ObjectHolder& at(Symbol name);
+    [[nodiscard]] const ObjectHolder& at(Symbol name) const;
+    ObjectHolder& operator[](Symbol name);
+
+private:
+    const Shape* shape_;
+    std::vector<ObjectHolder> values_;
+};
+
+// Специальные методы, которые интерпретатор вызывает сам, без обращения по имени
+enum class SpecialMethod : unsigned char {
+    Str,    // __str__(): строковое представление объекта
+    Equal,  // __eq__(rhs): сравнение на равенство
+    Less,   // __lt__(rhs): сравнение "меньше"
+    Add,    // __add__(rhs): сложение
+    Init,   // __init__(...): инициализация нового объекта
+    Count,
 };
 
 // Класс
 class Class : public Object {
 public:
     // Создаёт класс с именем name и набором методов methods, унаследованный от класса parent
-    // Если parent равен nullptr, то создаётся базовый класс
-    explicit Class(std::string name, std::vector<Method> methods, const Class* parent);
-
-    // Возвращает указатель на метод name или nullptr, если метод с таким именем отсутствует
-    [[nodiscard]] const Method* GetMethod(const std::string& name) const;
+    // Если parent равен nullptr, то создаётся базовый класс.
+    // Если тела методов размещены в арене method_storage, класс владеет ею
+    explicit Class(std::string name, std::vector<Method> methods, const Class* parent,
+                   std::unique_ptr<Arena> method_storage = nullptr);
+
+    // Возвращает указатель на метод name или nullptr, если метод с таким именем отсутствует.
+    // Поиск не зависит от глубины наследования
+    [[nodiscard]] const Method* GetMethod(Symbol name) const;
+
+    // Возвращает специальный метод kind, в том числе унаследованный, либо nullptr.
+    // Методы с числом параметров, отличным от ожидаемого, не считаются специальными.
+    // У __init__ число параметров может быть любым
+    [[nodiscard]] inline const Method* GetSpecialMethod(SpecialMethod kind) const {
+        return special_methods_[static_cast<size_t>(kind)];
+    }
 
     // Возвращает имя класса
     [[nodiscard]] inline const std::string& GetName() const { return name_; }
 
+    // Возвращает методы, объявленные в самом классе (без унаследованных)
+    [[nodiscard]] inline const std::vector<Method>& GetMethods() const { return methods_; }
+
+    // Возвращает форму только что созданного объекта класса
+    [[nodiscard]] inline const Shape& GetRootShape() const { return root_shape_; }
+
     // Выводит в os строку "Class <имя класса>", например "Class cat"
     void Print(std::ostream& os, Context& context) override;
 
 private:
+    std::unique_ptr<Arena> method_storage_;
     std::string name_;
     std::vector<Method> methods_;
-    std::unordered_map<std::string_view, size_t> methods_by_name_;
-    const Class *parent_;
+    // Все методы класса, включая унаследованные. Заполняется при создании класса:
+    // копируется таблица родителя, затем добавляются и переопределяются собственные методы
+    std::unordered_map<Symbol, const Method*> method_table_;
+    std::array<const Method*, static_cast<size_t>(SpecialMethod::Count)> special_methods_{};
+    Shape root_shape_;
 };
 
-// Экземпляр класса
+// Счётчики попаданий и промахов кешей методов. Ведутся, только если программа собрана
+// с MYTHON_METHOD_CACHE_STATS (одноимённая опция CMake); иначе остаются нулевыми
+struct MethodCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+/*
+ * Полиморфный встроенный кеш места вызова метода. Для нескольких последних классов получателя
+ * запоминает найденный метод либо его отсутствие, поэтому повторный вызов
+ * не ищет метод по имени и не обходит родительские классы
+ */
+class MethodCache {
+public:
+    static constexpr size_t CAPACITY = 4;
+
+    // Возвращает метод name класса cls, принимающий argument_count параметров, либо nullptr
+    [[nodiscard]] const Method* Lookup(const Class& cls, Symbol name,
+                                       size_t argument_count) {
+        for (size_t i = 0; i < size_; ++i) {
+            if (entries_[i].cls == &cls) {
+#ifdef MYTHON_METHOD_CACHE_STATS
+                ++stats_.hits;
+#endif
+                return entries_[i].method;
+            }
+        }
+        return Miss(cls, name, argument_count);
+    }
+
+    // Возвращает запомненный для cls метод, не изменяя счётчики. Если записи нет, nullptr
+    [[nodiscard]] const Method* Peek(const Class& cls) const {
+        for (size_t i = 0; i < size_; ++i) {
+            if (entries_[i].cls == &cls) {
+                return entries_[i].method;
+            }
+        }
+        return nullptr;
+    }
+
+    // Возвращает счётчики, общие для всех кешей
+    [[nodiscard]] static MethodCacheStats& Stats() { return stats_; }
+
+private:
+    const Method* Miss(const Class& cls, Symbol name, size_t argument_count);
+
+    struct Entry {
+        const Class* cls = nullptr;
+        const Method* method = nullptr;
+    };
+
+    std::array<Entry, CAPACITY> entries_;
+    size_t size_ = 0;
+    // Запись, вытесняемая при заполненном кеше
+    size_t victim_ = 0;
+
+    inline static MethodCacheStats stats_;
+};
+
+// Непрерывный диапазон значений аргументов вызова метода. Вызываемый метод переносит
+// значения в свой кадр, поэтому после вызова они не определены
+class ArgumentSpan {
+public:
+    ArgumentSpan() = default;
+
+    ArgumentSpan(ObjectHolder* data, size_t size)
+        : data_(data), size_(size) {
+    }
+
+    [[nodiscard]] ObjectHolder* begin() const {
+        return data_;
+    }
+
+    [[nodiscard]] ObjectHolder* end() const {
+        return data_ + size_;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return size_;
+    }
+
+private:
+    ObjectHolder* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Экземпляр класса. Если объект создан через ObjectHolder::Own, ссылку self на него
+// можно сделать владеющей (см. ObjectHolder::Retain)
 class ClassInstance : public Object {
 public:
     explicit ClassInstance(const Class& cls);
@@ -170,20 +804,36 @@ public:
      * Если ни сам класс, ни его родители не содержат метод method, метод выбрасывает исключение
      * runtime_error
      */
-    ObjectHolder Call(const std::string& method, const std::vector<ObjectHolder>& actual_args,
+    ObjectHolder Call(Symbol method, const std::vector<ObjectHolder>& actual_args,
+                      Context& context);
+
+    // Вызывает найденный заранее метод method класса объекта или его родителя.
+    // Размер actual_args должен совпадать с числом параметров метода
+    ObjectHolder Call(const Method& method, const std::vector<ObjectHolder>& actual_args,
                       Context& context);
 
+    // Вызывает найденный заранее метод method, перенося значения args в кадр вызова.
+    // Не ищет метод повторно и не выделяет память под аргументы.
+    // Размер args должен совпадать с числом параметров метода
+    ObjectHolder Call(const Method* method, ArgumentSpan args, Context& context);
+
+    // Возвращает метод method, принимающий argument_count параметров, либо nullptr
+    [[nodiscard]] const Method* FindMethod(Symbol method, size_t argument_count) const;
+
     // Возвращает true, если объект имеет метод method, принимающий argument_count параметров
-    [[nodiscard]] bool HasMethod(const std::string& method, size_t argument_count) const;
+    [[nodiscard]] bool HasMethod(Symbol method, size_t argument_count) const;
+
+    // Возвращает класс объекта
+    [[nodiscard]] inline const Class& GetClass() const { return cls_; }
 
-    // Возвращает ссылку на Closure, содержащий поля объекта
-    [[nodiscard]] Closure& Fields();
-    // Возвращает константную ссылку на Closure, содержащую поля объекта
-    [[nodiscard]] const Closure& Fields() const;
+    // Возвращает ссылку на таблицу полей объекта
+    [[nodiscard]] FieldTable& Fields();
+    // Возвращает константную ссылку на таблицу полей объекта
+    [[nodiscard]] const FieldTable& Fields() const;
 
 private:
     const Class & cls_;
-    Closure closure_;
+    FieldTable fields_;
 };
 
 /*
@@ -248,20 +898,18 @@ namespace detail{
 
     template<class BinaryPredicate>
     std::optional<bool> BaseCompare(const runtime::ObjectHolder &lhs, const runtime::ObjectHolder &rhs, BinaryPredicate predicate) {
-        std::optional<bool> result;
-        {
-            auto lhs_ = lhs.TryAs<runtime::Bool>(), rhs_ = rhs.TryAs<runtime::Bool>();
-            if (lhs_ && rhs_) { result = predicate(lhs_->GetValue(), rhs_->GetValue()); return result; }
+        const ObjectType type = lhs.GetType();
+        if (type != rhs.GetType()) { return std::nullopt; }
+        switch (type) {
+            case ObjectType::Bool:
+                return predicate(lhs.TryAs<runtime::Bool>()->GetValue(), rhs.TryAs<runtime::Bool>()->GetValue());
+            case ObjectType::Number:
+                return predicate(lhs.TryAs<runtime::Number>()->GetValue(), rhs.TryAs<runtime::Number>()->GetValue());
+            case ObjectType::String:
+                return predicate(lhs.TryAs<runtime::String>()->GetValue(), rhs.TryAs<runtime::String>()->GetValue());
+            default:
+                return std::nullopt;
         }
-        {
-            auto lhs_ = lhs.TryAs<runtime::Number>(), rhs_ = rhs.TryAs<runtime::Number>();
-            if (lhs_ && rhs_) { result = predicate(lhs_->GetValue(), rhs_->GetValue()); return result; }
-        }
-        {
-            auto lhs_ = lhs.TryAs<runtime::String>(), rhs_ = rhs.TryAs<runtime::String>();
-            if (lhs_ && rhs_) { result = predicate(lhs_->GetValue(), rhs_->GetValue()); return result; }
-        }
-        return result;
     }
 }
 
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace parse {
+
+// Положение в тексте программы. Строки и столбцы нумеруются с единицы,
+// нулевая строка означает, что положение неизвестно
+struct SourceLocation {
+    std::uint32_t line = 0;
+    std::uint32_t column = 0;
+
+    [[nodiscard]] bool IsKnown() const {
+        return line != 0;
+    }
+};
+
+inline bool operator==(SourceLocation lhs, SourceLocation rhs) {
+    return lhs.line == rhs.line && lhs.column == rhs.column;
+}
+
+inline bool operator!=(SourceLocation lhs, SourceLocation rhs) {
+    return !(lhs == rhs);
+}
+
+// Дополняет сообщение об ошибке положением в программе, если оно известно:
+// "line 3, column 7: message"
+inline std::string WithLocation(const std::string& message, SourceLocation location) {
+    if (!location.IsKnown()) {
+        return message;
+    }
+    return "line " + std::to_string(location.line) + ", column " + std::to_string(location.column)
+           + ": " + message;
+}
+
+}  // namespace parse
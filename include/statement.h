@@ -7,10 +7,43 @@
 #include <algorithm>
 #include <cmath>
 
+namespace vm {
+class Compiler;
+}  // namespace vm
+
 namespace ast {
 
 using Statement = runtime::Executable;
 
+// Указатель на дочерний узел дерева. Узлы, построенные парсером, размещены в арене программы
+// и освобождаются вместе с ней, а не по одному
+using StatementPtr = runtime::ExecutablePtr;
+
+// Инструкция, внутри которой может быть выполнена инструкция return.
+// О выполненном return она сообщает возвращаемым значением, а не исключением,
+// поэтому выход из метода стоит не дороже обычного возврата из функции
+class ControlFlow {
+public:
+    // Исполняет инструкцию. Если внутри неё был выполнен return, записывает его значение
+    // в result и возвращает true. В противном случае возвращает false
+    virtual bool ExecuteFlow(runtime::Closure& closure, runtime::Context& context,
+                             runtime::ObjectHolder& result) = 0;
+
+protected:
+    ~ControlFlow() = default;
+};
+
+// Исполняет инструкцию stmt с учётом return. flow - это stmt, приведённый к ControlFlow,
+// либо nullptr, если stmt не может содержать return
+inline bool ExecuteFlow(Statement& stmt, ControlFlow* flow, runtime::Closure& closure,
+                        runtime::Context& context, runtime::ObjectHolder& result) {
+    if (flow) {
+        return flow->ExecuteFlow(closure, context, result);
+    }
+    stmt.Execute(closure, context);
+    return false;
+}
+
 // Выражение, возвращающее значение типа T,
 // используется как основа для создания констант
 template <typename T>
@@ -25,6 +58,8 @@ public:
         return runtime::ObjectHolder::Share(value_);
     }
 
+    friend class vm::Compiler;
+
 private:
     T value_;
 };
@@ -40,41 +75,52 @@ x = circle.center.x
 */
 class VariableValue : public Statement {
 public:
-    explicit VariableValue(const std::string& var_name);
-    explicit VariableValue(std::vector<std::string> dotted_ids);
+    explicit VariableValue(runtime::Symbol var_name);
+    explicit VariableValue(std::vector<runtime::Symbol> dotted_ids);
+    explicit VariableValue(const std::vector<std::string>& dotted_ids);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    friend class vm::Compiler;
+
 private:
     std::string GetStrDottedIds();
 
 private:
-    std::vector<std::string> dotted_ids_;
+    std::vector<runtime::Symbol> dotted_ids_;
+    // Кеши обращения к полям: элемент i используется, когда id[i] - поле объекта
+    std::vector<runtime::FieldCache> field_caches_;
 };
 
 // Присваивает переменной, имя которой задано в параметре var, значение выражения rv
 class Assignment : public Statement {
 public:
-    Assignment(std::string var, std::unique_ptr<Statement> rv);
+    Assignment(runtime::Symbol var, StatementPtr rv);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    friend class vm::Compiler;
+
 private:
-    const std::string var_;
-    std::unique_ptr<Statement> rv_;
+    const runtime::Symbol var_;
+    StatementPtr rv_;
 };
 
 // Присваивает полю object.field_name значение выражения rv
 class FieldAssignment : public Statement {
 public:
-    FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
+    FieldAssignment(VariableValue object, runtime::Symbol field_name,
+                    StatementPtr rv);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    friend class vm::Compiler;
+
 private:
     VariableValue object_;
-    std::string field_name_;
-    std::unique_ptr<Statement> rv_;
+    runtime::Symbol field_name_;
+    StatementPtr rv_;
+    runtime::FieldCache field_cache_;
 };
 
 // Значение None
@@ -90,9 +136,9 @@ public:
 class Print : public Statement {
 public:
     // Инициализирует команду print для вывода значения выражения argument
-    explicit Print(std::unique_ptr<Statement> argument);
+    explicit Print(StatementPtr argument);
     // Инициализирует команду print для вывода списка значений args
-    explicit Print(std::vector<std::unique_ptr<Statement>> args);
+    explicit Print(std::vector<StatementPtr> args);
 
     // Инициализирует команду print для вывода значения переменной name
     static std::unique_ptr<Print> Variable(const std::string& name);
@@ -101,22 +147,26 @@ public:
     // context.GetOutputStream()
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    friend class vm::Compiler;
+
 private:
-    std::vector<std::unique_ptr<Statement>> args_;
+    std::vector<StatementPtr> args_;
 };
 
 // Вызывает метод object.method со списком параметров args
 class MethodCall : public Statement {
 public:
-    MethodCall(std::unique_ptr<Statement> object, std::string method,
-               std::vector<std::unique_ptr<Statement>> args);
+    MethodCall(StatementPtr object, runtime::Symbol method, std::vector<StatementPtr> args);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    friend class vm::Compiler;
+
 private:
-    std::unique_ptr<Statement> object_;
-    std::string method_;
-    std::vector<std::unique_ptr<Statement>> args_;
+    StatementPtr object_;
+    runtime::Symbol method_;
+    std::vector<StatementPtr> args_;
+    runtime::MethodCache method_cache_;
 };
 
 /*
@@ -135,25 +185,31 @@ p.set_name("Ivan")
 class NewInstance : public Statement {
 public:
     explicit NewInstance(const runtime::Class& class_);
-    NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args);
+    NewInstance(const runtime::Class& class_, std::vector<StatementPtr> args);
     // Возвращает объект, содержащий значение типа ClassInstance
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    friend class vm::Compiler;
+
 private:
-    runtime::ClassInstance class_instance_;
-    std::vector<std::unique_ptr<Statement>> args_;
+    // Объект принадлежит узлу совместно с переменными и полями, в которые он записан,
+    // поэтому переживает узел, если тот освобождается раньше конца программы
+    runtime::ObjectHolder class_instance_;
+    std::vector<StatementPtr> args_;
 };
 
 // Базовый класс для унарных операций
 class UnaryOperation : public Statement {
 public:
-    explicit UnaryOperation(std::unique_ptr<Statement> argument) :
+    explicit UnaryOperation(StatementPtr argument) :
         argument_(std::move(argument)) {
 
     }
 
+    friend class vm::Compiler;
+
 protected:
-    std::unique_ptr<Statement> argument_;
+    StatementPtr argument_;
 };
 
 // Операция str, возвращающая строковое значение своего аргумента
@@ -166,13 +222,15 @@ public:
 // Родительский класс Бинарная операция с аргументами lhs и rhs
 class BinaryOperation : public Statement {
 public:
-    BinaryOperation(std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs):
+    BinaryOperation(StatementPtr lhs, StatementPtr rhs):
         lhs_(std::move(lhs)), rhs_(std::move(rhs)) {
 
     }
 
+    friend class vm::Compiler;
+
 protected:
-    std::unique_ptr<Statement> lhs_, rhs_;
+    StatementPtr lhs_, rhs_;
 };
 
 // Возвращает результат операции + над аргументами lhs и rhs
@@ -222,7 +280,8 @@ public:
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 };
 
-// Возвращает результат вычисления логической операции or над lhs и rhs
+// Возвращает результат вычисления логической операции or над lhs и rhs.
+// rhs вычисляется, только если lhs приводится к False
 class Or : public BinaryOperation {
 public:
     using BinaryOperation::BinaryOperation;
@@ -231,7 +290,8 @@ public:
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 };
 
-// Возвращает результат вычисления логической операции and над lhs и rhs
+// Возвращает результат вычисления логической операции and над lhs и rhs.
+// rhs вычисляется, только если lhs приводится к True
 class And : public BinaryOperation {
 public:
     using BinaryOperation::BinaryOperation;
@@ -248,22 +308,29 @@ class Not : public UnaryOperation {
 };
 
 // Составная инструкция (например: тело метода, содержимое ветки if, либо else)
-class Compound : public Statement {
+class Compound : public Statement, public ControlFlow {
 public:
-    // Конструирует Compound из нескольких инструкций типа unique_ptr<Statement>
+    // Конструирует Compound из нескольких инструкций типа StatementPtr
     template <typename... Args>
     explicit Compound(Args&&... args) {
         AddStatement(args...);
     }
 
     // Добавляет очередную инструкцию в конец составной инструкции
-    void AddStatement(std::unique_ptr<Statement> stmt) {
+    void AddStatement(StatementPtr stmt) {
+        flows_.push_back(dynamic_cast<ControlFlow*>(stmt.get()));
         args_.push_back(std::move(stmt));
     }
 
     // Последовательно выполняет добавленные инструкции. Возвращает None
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    // Последовательно выполняет добавленные инструкции, останавливаясь на первом return
+    bool ExecuteFlow(runtime::Closure& closure, runtime::Context& context,
+                     runtime::ObjectHolder& result) override;
+
+    friend class vm::Compiler;
+
 private:
     void AddStatement() {/*nothing*/}
 
@@ -274,37 +341,56 @@ private:
     }
 
 private:
-    std::vector<std::unique_ptr<Statement>> args_;
+    std::vector<StatementPtr> args_;
+    // flows_[i] - это args_[i], приведённый к ControlFlow
+    std::vector<ControlFlow*> flows_;
 };
 
 // Тело метода. Как правило, содержит составную инструкцию
 class MethodBody : public Statement {
 public:
-    explicit MethodBody(std::unique_ptr<Statement>&& body);
+    explicit MethodBody(StatementPtr&& body);
 
     // Вычисляет инструкцию, переданную в качестве body.
     // Если внутри body была выполнена инструкция return, возвращает результат return
     // В противном случае возвращает None
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    // Передаёт кадр вызова скомпилированному представлению, если оно задано
+    runtime::ObjectHolder Call(const runtime::Method& method, runtime::ObjectHolder* frame,
+                               runtime::Context& context) override;
+
+    // Задаёт скомпилированное представление body, которое исполняется вместо него
+    void SetCompiled(std::unique_ptr<Statement> compiled);
+
+    friend class vm::Compiler;
+
 private:
-    std::unique_ptr<Statement> body_;
+    StatementPtr body_;
+    ControlFlow* body_flow_;
+    std::unique_ptr<Statement> compiled_;
 };
 
 // Выполняет инструкцию return с выражением statement
-class Return : public Statement {
+class Return : public Statement, public ControlFlow {
 public:
-    explicit Return(std::unique_ptr<Statement> statement):
+    explicit Return(StatementPtr statement):
         statement_(std::move(statement)) {
 
     }
 
+    // Возвращает результат вычисления выражения statement
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
     // Останавливает выполнение текущего метода. После выполнения инструкции return метод,
     // внутри которого она была исполнена, должен вернуть результат вычисления выражения statement.
-    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    bool ExecuteFlow(runtime::Closure& closure, runtime::Context& context,
+                     runtime::ObjectHolder& result) override;
+
+    friend class vm::Compiler;
 
  private:
-  std::unique_ptr<Statement> statement_;
+  StatementPtr statement_;
 };
 
 // Объявляет класс
@@ -317,21 +403,29 @@ public:
     // конструктор
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    friend class vm::Compiler;
+
 private:
     runtime::ObjectHolder cls_;
 };
 
 // Инструкция if <condition> <if_body> else <else_body>
-class IfElse : public Statement {
+class IfElse : public Statement, public ControlFlow {
 public:
     // Параметр else_body может быть равен nullptr
-    IfElse(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> if_body,
-           std::unique_ptr<Statement> else_body);
+    IfElse(StatementPtr condition, StatementPtr if_body, StatementPtr else_body);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    // Исполняет выбранную ветку, сообщая о выполненном внутри неё return
+    bool ExecuteFlow(runtime::Closure& closure, runtime::Context& context,
+                     runtime::ObjectHolder& result) override;
+
+    friend class vm::Compiler;
+
  private:
-  std::unique_ptr<Statement> condition_, if_body_, else_body_;
+  StatementPtr condition_, if_body_, else_body_;
+  ControlFlow *if_flow_, *else_flow_;
 };
 
 // Операция сравнения
@@ -341,14 +435,56 @@ public:
     using Comparator = std::function<bool(const runtime::ObjectHolder&,
                                           const runtime::ObjectHolder&, runtime::Context&)>;
 
-    Comparison(Comparator cmp, std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs);
+    Comparison(Comparator cmp, StatementPtr lhs, StatementPtr rhs);
 
     // Вычисляет значение выражений lhs и rhs и возвращает результат работы comparator,
     // приведённый к типу runtime::Bool
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 
+    friend class vm::Compiler;
+
 private:
     Comparator cmp_;
 };
 
-}  // namespace ast
\ No newline at end of file
+// Программа, разобранная парсером: корень дерева и арена, в которой размещены его узлы.
+// Дерево освобождается вместе с ареной, без рекурсивного обхода узлов
+class Program : public Statement {
+public:
+    Program(std::unique_ptr<runtime::Arena> arena, StatementPtr body):
+        arena_(std::move(arena)), body_(std::move(body)) {
+    }
+
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override {
+        return body_->Execute(closure, context);
+    }
+
+    [[nodiscard]] Statement& GetBody() const {
+        return *body_;
+    }
+
+private:
+    std::unique_ptr<runtime::Arena> arena_;
+    StatementPtr body_;
+};
+
+}  // namespace ast
+
+namespace runtime {
+// Узлы, которые владеют только дочерними узлами. Парсер размещает детей в той же арене,
+// поэтому деструкторы таких узлов ничего не освобождают и арена их не вызывает
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::NumericConst> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::BoolConst> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::None> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::Assignment> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::Return> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::IfElse> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::Stringify> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::Not> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::Add> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::Sub> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::Mult> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::Div> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::Or> = false;
+template <> inline constexpr bool ARENA_NEEDS_CLEANUP<ast::And> = false;
+}  // namespace runtime
\ No newline at end of file
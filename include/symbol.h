@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+namespace runtime {
+
+/*
+ * Интернированное имя: идентификатор, переменная, поле или метод.
+ * Строка с именем хранится в глобальной таблице символов в единственном экземпляре,
+ * а Symbol - лишь указатель на неё вместе с заранее вычисленным хешем.
+ * Поэтому копирование и сравнение символов не выделяют память и не сравнивают строки.
+ * Символы живут до завершения программы
+ */
+class Symbol {
+public:
+    // Создаёт символ с пустым именем
+    Symbol();
+
+    // Находит имя в таблице символов, при необходимости добавляя его туда
+    Symbol(std::string_view name);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+    Symbol(const std::string& name)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : Symbol(std::string_view{name}) {
+    }
+    Symbol(const char* name)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : Symbol(std::string_view{name}) {
+    }
+
+    [[nodiscard]] inline const std::string& GetName() const {
+        return entry_->name;
+    }
+
+    [[nodiscard]] inline std::size_t GetHash() const {
+        return entry_->hash;
+    }
+
+    friend bool operator==(Symbol lhs, Symbol rhs) {
+        return lhs.entry_ == rhs.entry_;
+    }
+
+    friend bool operator!=(Symbol lhs, Symbol rhs) {
+        return lhs.entry_ != rhs.entry_;
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        std::size_t hash;
+    };
+
+    static const Entry* Intern(std::string_view name);
+
+    const Entry* entry_;
+};
+
+std::ostream& operator<<(std::ostream& os, Symbol symbol);
+
+}  // namespace runtime
+
+template <>
+struct std::hash<runtime::Symbol> {
+    std::size_t operator()(runtime::Symbol symbol) const noexcept {
+        return symbol.GetHash();
+    }
+};
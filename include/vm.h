@@ -0,0 +1,175 @@
+#pragma once
+
+#include "runtime.h"
+#include "source_location.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vm {
+
+// Список инструкций байткода. Порядок элементов задаёт и значения OpCode,
+// и таблицу переходов диспетчера, поэтому новые инструкции добавляются только сюда
+#define MYTHON_OPCODES(X)                                                                      \
+    X(LoadConst)      /* R[a] = K[b]                                                       */ \
+    X(LoadNone)       /* R[a] = None                                                       */ \
+    X(Move)           /* R[a] = R[b]                                                       */ \
+    X(LoadLocal)      /* R[a] = R[b], где b - слот; ошибка, если переменная не определена */ \
+    X(LoadDotted)     /* R[a] = значение цепочки полей F[b]                                */ \
+    X(LoadInstance)   /* R[a] = значение цепочки полей F[b], обязано быть ClassInstance    */ \
+    X(StoreField)     /* R[a].N[b] = R[c]                                                  */ \
+    X(Add)            /* R[a] = R[b] + R[c]                                                */ \
+    X(Sub)            /* R[a] = R[b] - R[c]                                                */ \
+    X(Mult)           /* R[a] = R[b] * R[c]                                                */ \
+    X(Div)            /* R[a] = R[b] / R[c]                                                */ \
+    X(Equal)          /* R[a] = R[b] == R[c]                                               */ \
+    X(NotEqual)       /* R[a] = R[b] != R[c]                                               */ \
+    X(Less)           /* R[a] = R[b] < R[c]                                                */ \
+    X(Greater)        /* R[a] = R[b] > R[c]                                                */ \
+    X(LessOrEqual)    /* R[a] = R[b] <= R[c]                                               */ \
+    X(GreaterOrEqual) /* R[a] = R[b] >= R[c]                                               */ \
+    X(Compare)        /* R[a] = C[c](R[b], R[b + 1])                                       */ \
+    X(Truth)          /* R[a] = bool(R[b]), R[b] не может быть None                        */ \
+    X(Not)            /* R[a] = not R[b]                                                   */ \
+    X(Stringify)      /* R[a] = str(R[b])                                                  */ \
+    X(PrintArg)       /* печатает R[a], если b != 0, перед значением выводится пробел      */ \
+    X(PrintNewline)   /* печатает перевод строки                                           */ \
+    X(LookupMethod)   /* если у R[b] нет метода S[c], R[a] = None и переход на S[c].skip   */ \
+    X(CallMethod)     /* R[a] = R[b].S[c](R[S[c].args], ..., R[S[c].args + argc - 1])     */ \
+    X(ExecuteNode)    /* R[a] = E[b]->Execute(closure, context)                            */ \
+    X(Jump)           /* переход на инструкцию a                                           */ \
+    X(JumpIfFalse)    /* если R[a] приводится к False, переход на инструкцию b             */ \
+    X(JumpIfTrue)     /* если R[a] приводится к True, переход на инструкцию b              */ \
+    X(Return)         /* возвращает R[a]                                                   */ \
+    X(ReturnNone)     /* возвращает None                                                   */
+
+enum class OpCode : std::uint8_t {
+#define MYTHON_OPCODE_ENUM(name) name,
+    MYTHON_OPCODES(MYTHON_OPCODE_ENUM)
+#undef MYTHON_OPCODE_ENUM
+};
+
+// Трёхадресная инструкция регистровой машины
+struct Instruction {
+    OpCode op;
+    std::uint32_t a = 0;
+    std::uint32_t b = 0;
+    std::uint32_t c = 0;
+};
+
+// Место вызова метода: имя, число аргументов, регистр первого из них
+// и адрес, куда перейти, если метода нет
+struct CallSite {
+    runtime::Symbol method;
+    std::uint32_t argc = 0;
+    std::uint32_t args = 0;
+    std::uint32_t skip = 0;
+    mutable runtime::MethodCache cache;
+};
+
+// Цепочка полей id1.id2.id3. Значение id1 хранится в слоте slot.
+// caches[i] - кеш обращения к полю ids[i]
+struct FieldChain {
+    std::uint32_t slot = 0;
+    std::vector<runtime::Symbol> ids;
+    mutable std::vector<runtime::FieldCache> caches;
+};
+
+// Место записи в поле объекта
+struct FieldSite {
+    runtime::Symbol name;
+    mutable runtime::FieldCache cache;
+};
+
+// Начиная с инструкции pc и до следующей записи код относится к месту location программы
+struct LocationEntry {
+    std::uint32_t pc = 0;
+    parse::SourceLocation location;
+};
+
+using Comparator = std::function<bool(const runtime::ObjectHolder&,
+                                      const runtime::ObjectHolder&, runtime::Context&)>;
+
+// Скомпилированное тело метода или программы.
+// Локальные переменные разрешаются при компиляции: переменная locals[i] хранится
+// в регистре i, а Closure служит лишь представлением кадра для кода, работающего с именами
+struct Chunk {
+    std::vector<Instruction> code;
+    // K: константы
+    std::vector<runtime::ObjectHolder> constants;
+    // N: места записи в поля
+    std::vector<FieldSite> fields;
+    // F: цепочки полей
+    std::vector<FieldChain> chains;
+    // S: места вызова методов
+    std::vector<CallSite> calls;
+    // C: пользовательские функции сравнения
+    std::vector<Comparator> comparators;
+    // E: узлы AST, которые исполняются без компиляции
+    std::vector<runtime::Executable*> nodes;
+    // Имена локальных переменных в порядке слотов
+    std::vector<runtime::Symbol> locals;
+    // Число первых слотов, значения которых при входе берутся из closure
+    std::uint32_t imported_locals = 0;
+    // Если true, при выходе значения слотов записываются обратно в closure
+    bool export_locals = false;
+    // Количество регистров, необходимое для исполнения
+    std::uint32_t register_count = 0;
+    // Положения инструкций в программе, упорядочены по pc. Хранятся отдельно от кода,
+    // чтобы не увеличивать инструкции, и читаются только при ошибке или профилировании
+    std::vector<LocationEntry> locations;
+
+    // Место программы, к которому относится инструкция pc
+    [[nodiscard]] parse::SourceLocation LocationAt(std::uint32_t pc) const;
+};
+
+// Ошибка исполнения с положением в программе инструкции, при исполнении которой она возникла
+class ExecutionError : public std::runtime_error {
+public:
+    ExecutionError(const std::string& message, parse::SourceLocation location)
+        : std::runtime_error(parse::WithLocation(message, location)), location_(location) {
+    }
+
+    [[nodiscard]] parse::SourceLocation GetLocation() const {
+        return location_;
+    }
+
+private:
+    parse::SourceLocation location_;
+};
+
+// Исполняет chunk. Первые imported_locals слотов заполняются значениями из closure,
+// а при export_locals значения переменных по завершении записываются в closure.
+// Возвращает значение, переданное инструкции Return, либо None.
+// Ошибки std::runtime_error заменяются на ExecutionError, если известно место их возникновения
+runtime::ObjectHolder Run(const Chunk& chunk, runtime::Closure& closure, runtime::Context& context);
+
+// Исполняет chunk, перенося значения первых imported_locals слотов из arguments
+runtime::ObjectHolder Run(const Chunk& chunk, runtime::ObjectHolder* arguments,
+                          runtime::Context& context);
+
+// Исполняемый байткод. Если задан source, он остаётся жив, пока жив байткод
+class Code : public runtime::Executable {
+public:
+    explicit Code(Chunk chunk, std::unique_ptr<runtime::Executable> source = nullptr);
+
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    // Исполняет скомпилированное тело метода прямо на кадре вызова, без Closure
+    runtime::ObjectHolder Call(const runtime::Method& method, runtime::ObjectHolder* frame,
+                               runtime::Context& context) override;
+
+    [[nodiscard]] const Chunk& GetChunk() const {
+        return chunk_;
+    }
+
+private:
+    Chunk chunk_;
+    std::unique_ptr<runtime::Executable> source_;
+};
+
+}  // namespace vm
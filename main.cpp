@@ -1,8 +1,23 @@
+#ifndef NDEBUG
 #define NDEBUG
+#endif
+#include <cstdlib>
 #include <iostream>
 #include <filesystem>
 #include <fstream>
-
+#include <iterator>
+#include <optional>
+#include <string_view>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MYTHON_HAS_MMAP
+#endif
+
+#include "./include/compiler.h"
 #include "./include/lexer.h"
 #include "./include/parse.h"
 #include "./include/runtime.h"
@@ -20,18 +35,90 @@ namespace runtime {
     void RunObjectHolderTests(TestRunner& tr);
     void RunObjectsTests(TestRunner& tr);
 }  // namespace runtime
+namespace vm {
+    void RunVmTests(TestRunner& tr);
+}  // namespace vm
 
 void TestParseProgram(TestRunner& tr);
 
 namespace {
 
+    // Содержимое исходного файла. Если возможно, файл отображается в память,
+    // иначе читается в буфер целиком
+    class SourceFile {
+    public:
+        explicit SourceFile(const std::filesystem::path& path) {
+#ifdef MYTHON_HAS_MMAP
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return;
+            }
+            struct stat info{};
+            if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+                void* data = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED) {
+                    mapping_ = data;
+                    text_ = {static_cast<const char*>(data), static_cast<size_t>(info.st_size)};
+                }
+            }
+            ::close(fd);
+            opened_ = true;
+            if (mapping_ != nullptr) {
+                return;
+            }
+#endif
+            ifstream file(path, ios::binary);
+            opened_ = file.is_open();
+            buffer_.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+            text_ = buffer_;
+        }
+
+        SourceFile(const SourceFile&) = delete;
+        SourceFile& operator=(const SourceFile&) = delete;
+
+        ~SourceFile() {
+#ifdef MYTHON_HAS_MMAP
+            if (mapping_ != nullptr) {
+                ::munmap(mapping_, text_.size());
+            }
+#endif
+        }
+
+        [[nodiscard]] bool IsOpen() const {
+            return opened_;
+        }
+
+        [[nodiscard]] string_view Text() const {
+            return text_;
+        }
+
+    private:
+        void* mapping_ = nullptr;
+        string buffer_;
+        string_view text_;
+        bool opened_ = false;
+    };
+
+    void RunMythonProgram(parse::Lexer& lexer, ostream& output) {
+        parse::SourceMap locations;
+        auto program = vm::Compile(ParseProgram(lexer, locations), &locations);
+
+        runtime::SimpleContext context{output};
+        runtime::Closure closure;
+        program->Execute(closure, context);
+    }
+
     void RunMythonProgram(istream& input, ostream& output) {
         parse::Lexer lexer(input);
-        auto program = ParseProgram(lexer);
+        RunMythonProgram(lexer, output);
+    }
 
+    // Исполняет инструкции по мере чтения программы, не сохраняя её дерево целиком
+    void RunMythonProgramIncrementally(istream& input, ostream& output) {
+        parse::Lexer lexer(input);
         runtime::SimpleContext context{output};
         runtime::Closure closure;
-        program->Execute(closure, context);
+        vm::ExecuteIncrementally(lexer, closure, context);
     }
 
     void TestSimplePrints() {
@@ -119,6 +206,7 @@ print y.value
         runtime::RunObjectsTests(tr);
         ast::RunUnitTests(tr);
         TestParseProgram(tr);
+        vm::RunVmTests(tr);
 
         RUN_TEST(tr, TestSimplePrints);
         RUN_TEST(tr, TestAssignments);
@@ -132,18 +220,29 @@ int main(int argc, const char** argv) {
     #ifndef NDEBUG
         TestAll();
     #endif
-    if (argc != 3) {
+    // С ключом --stream инструкции исполняются по мере чтения, а память, занимаемая
+    // программой, не зависит от её длины. В этом режиме программа может читаться из stdin
+    const bool streaming = argc == 4 && argv[1] == "--stream"sv;
+    if (argc != 3 && !streaming) {
         cerr << "Mython interpreter!"sv << endl;
         std::filesystem::path interpreter = argv[0];
-        cerr << "Usage: "sv << interpreter.filename() << " <in_file> <out_file>"sv << endl;
+        cerr << "Usage: "sv << interpreter.filename() << " [--stream] <in_file> <out_file>"sv << endl;
+        cerr << "With --stream, <in_file> may be - to read the program from stdin"sv << endl;
         return 1;
     }
 
-    std::filesystem::path in_path = argv[1];
-    std::filesystem::path out_path = argv[2];
+    std::filesystem::path in_path = argv[argc - 2];
+    std::filesystem::path out_path = argv[argc - 1];
 
-    ifstream ifile(in_path);
-    if (!ifile.is_open()) {
+    const bool from_stdin = streaming && in_path == "-";
+    ifstream ifile;
+    std::optional<SourceFile> source;
+    if (streaming && !from_stdin) {
+        ifile.open(in_path);
+    } else if (!streaming) {
+        source.emplace(in_path);
+    }
+    if (!from_stdin && !(streaming ? ifile.is_open() : source->IsOpen())) {
         std::cerr << "Can't open file "s << in_path << endl;
     }
     ofstream ofile(out_path);
@@ -152,10 +251,27 @@ int main(int argc, const char** argv) {
     }
 
     try {
-        RunMythonProgram(ifile, ofile);
+        if (streaming) {
+            RunMythonProgramIncrementally(from_stdin ? cin : ifile, ofile);
+        } else {
+            // Большие программы разбиваются на токены в несколько потоков заранее,
+            // остальные - по одной строке по мере разбора
+            const string_view text = source->Text();
+            parse::Lexer lexer = text.size() >= 2 * parse::TokenBuffer::PARALLEL_CHUNK_SIZE
+                                     ? parse::Lexer(parse::TokenBuffer::TokenizeParallel(text))
+                                     : parse::Lexer(text);
+            RunMythonProgram(lexer, ofile);
+        }
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         return 1;
     }
+#ifdef MYTHON_METHOD_CACHE_STATS
+    // Статистика кешей методов выводится по запросу: MYTHON_STATS=1 Mython in out
+    if (std::getenv("MYTHON_STATS")) {
+        const auto& stats = runtime::MethodCache::Stats();
+        std::cerr << "method cache: hits "sv << stats.hits << ", misses "sv << stats.misses << endl;
+    }
+#endif
     return 0;
 }
\ No newline at end of file
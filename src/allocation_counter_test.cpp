@@ -0,0 +1,35 @@
+#include "../include/allocation_counter_p.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+std::atomic<std::size_t> allocation_count{0};
+}  // namespace
+
+namespace allocation_counter {
+
+std::size_t Count() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+}  // namespace allocation_counter
+
+#ifndef NDEBUG
+void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t /*size*/) noexcept {
+    std::free(memory);
+}
+#endif
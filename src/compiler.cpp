@@ -0,0 +1,521 @@
+#include "../include/compiler.h"
+
+#include "../include/statement.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+namespace vm {
+
+using runtime::Executable;
+using runtime::ObjectHolder;
+
+namespace {
+using RuntimeComparator = bool (*)(const ObjectHolder&, const ObjectHolder&, runtime::Context&);
+
+// Сопоставляет стандартные функции сравнения отдельным инструкциям,
+// чтобы не вызывать их через std::function
+std::optional<OpCode> ComparisonOpCode(const ast::Comparison::Comparator& cmp) {
+    const auto* target = cmp.target<RuntimeComparator>();
+    if (target == nullptr) {
+        return std::nullopt;
+    }
+    static const std::pair<RuntimeComparator, OpCode> known[] = {
+        {runtime::Equal, OpCode::Equal},
+        {runtime::NotEqual, OpCode::NotEqual},
+        {runtime::Less, OpCode::Less},
+        {runtime::Greater, OpCode::Greater},
+        {runtime::LessOrEqual, OpCode::LessOrEqual},
+        {runtime::GreaterOrEqual, OpCode::GreaterOrEqual},
+    };
+    for (const auto& [function, op] : known) {
+        if (*target == function) {
+            return op;
+        }
+    }
+    return std::nullopt;
+}
+}  // namespace
+
+// Переводит дерево ast::Statement в байткод. Один экземпляр компилирует одно тело.
+// Каждой локальной переменной тела назначается постоянный регистр-слот,
+// временные значения располагаются в регистрах после слотов
+class Compiler {
+public:
+    explicit Compiler(const parse::SourceMap* locations = nullptr)
+        : locations_(locations) {
+    }
+
+    // Компилирует программу. Все её переменные читаются из closure при входе
+    // и записываются в closure при выходе. Чтобы не компилировать
+    // методы повторно, classes хранит уже обработанные классы
+    Chunk CompileProgram(Executable& body, std::unordered_set<const runtime::Class*>& classes) {
+        ResolveLocals(body);
+        chunk_.imported_locals = static_cast<uint32_t>(chunk_.locals.size());
+        chunk_.export_locals = true;
+        return CompileBody(body, classes);
+    }
+
+    // Компилирует тело метода: из closure читаются только self и параметры
+    Chunk CompileMethod(const runtime::Method& method, Executable& body,
+                        std::unordered_set<const runtime::Class*>& classes) {
+        DeclareLocal(SELF);
+        for (const auto& param : method.formal_params) {
+            DeclareLocal(param);
+        }
+        chunk_.imported_locals = static_cast<uint32_t>(chunk_.locals.size());
+        ResolveLocals(body);
+        return CompileBody(body, classes);
+    }
+
+private:
+    Chunk CompileBody(Executable& body, std::unordered_set<const runtime::Class*>& classes) {
+        classes_ = &classes;
+        first_temp_ = static_cast<uint32_t>(chunk_.locals.size());
+        next_register_ = max_registers_ = first_temp_;
+        // Параметры метода определены всегда, переменные программы - неизвестно
+        bound_.assign(chunk_.locals.size(), false);
+        if (!chunk_.export_locals) {
+            std::fill_n(bound_.begin(), chunk_.imported_locals, true);
+        }
+        CompileStatement(body);
+        Emit(OpCode::ReturnNone);
+        chunk_.register_count = max_registers_;
+        return std::move(chunk_);
+    }
+
+    // Назначает слоты всем именам, которым в теле присваивается значение или которые
+    // в нём читаются. Тела методов вложенных определений классов не просматриваются
+    void ResolveLocals(Executable& node) {
+        if (auto* compound = dynamic_cast<ast::Compound*>(&node)) {
+            for (auto& child : compound->args_) {
+                ResolveLocals(*child);
+            }
+        } else if (auto* if_else = dynamic_cast<ast::IfElse*>(&node)) {
+            ResolveLocals(*if_else->condition_);
+            ResolveLocals(*if_else->if_body_);
+            if (if_else->else_body_) {
+                ResolveLocals(*if_else->else_body_);
+            }
+        } else if (auto* ret = dynamic_cast<ast::Return*>(&node)) {
+            ResolveLocals(*ret->statement_);
+        } else if (auto* print = dynamic_cast<ast::Print*>(&node)) {
+            for (auto& arg : print->args_) {
+                ResolveLocals(*arg);
+            }
+        } else if (auto* definition = dynamic_cast<ast::ClassDefinition*>(&node)) {
+            DeclareLocal(definition->cls_.TryAs<runtime::Class>()->GetName());
+        } else if (auto* variable = dynamic_cast<ast::VariableValue*>(&node)) {
+            DeclareLocal(variable->dotted_ids_.front());
+        } else if (auto* assignment = dynamic_cast<ast::Assignment*>(&node)) {
+            DeclareLocal(assignment->var_);
+            ResolveLocals(*assignment->rv_);
+        } else if (auto* field_assignment = dynamic_cast<ast::FieldAssignment*>(&node)) {
+            DeclareLocal(field_assignment->object_.dotted_ids_.front());
+            ResolveLocals(*field_assignment->rv_);
+        } else if (auto* call = dynamic_cast<ast::MethodCall*>(&node)) {
+            ResolveLocals(*call->object_);
+            for (auto& arg : call->args_) {
+                ResolveLocals(*arg);
+            }
+        } else if (auto* instance = dynamic_cast<ast::NewInstance*>(&node)) {
+            for (auto& arg : instance->args_) {
+                ResolveLocals(*arg);
+            }
+        } else if (auto* unary = dynamic_cast<ast::UnaryOperation*>(&node)) {
+            ResolveLocals(*unary->argument_);
+        } else if (auto* binary = dynamic_cast<ast::BinaryOperation*>(&node)) {
+            ResolveLocals(*binary->lhs_);
+            ResolveLocals(*binary->rhs_);
+        }
+    }
+
+    uint32_t DeclareLocal(runtime::Symbol name) {
+        auto [it, inserted] =
+            slots_.emplace(name, static_cast<uint32_t>(chunk_.locals.size()));
+        if (inserted) {
+            chunk_.locals.push_back(name);
+        }
+        return it->second;
+    }
+
+    // Временные регистры, выделенные внутри области, освобождаются при выходе из неё
+    class RegisterScope {
+    public:
+        explicit RegisterScope(Compiler& compiler)
+            : compiler_(compiler), saved_(compiler.next_register_) {
+        }
+
+        ~RegisterScope() {
+            compiler_.next_register_ = saved_;
+        }
+
+    private:
+        Compiler& compiler_;
+        uint32_t saved_;
+    };
+
+    // Инструкции, порождённые внутри области, относятся к месту узла node в программе
+    class LocationScope {
+    public:
+        LocationScope(Compiler& compiler, const Executable& node)
+            : compiler_(compiler), saved_(compiler.location_) {
+            if (compiler.locations_ != nullptr) {
+                if (const auto location = compiler.locations_->Find(&node); location.IsKnown()) {
+                    compiler.location_ = location;
+                }
+            }
+        }
+
+        ~LocationScope() {
+            compiler_.location_ = saved_;
+        }
+
+    private:
+        Compiler& compiler_;
+        parse::SourceLocation saved_;
+    };
+
+    void CompileStatement(Executable& stmt) {
+        RegisterScope scope(*this);
+        LocationScope location(*this, stmt);
+
+        if (auto* compound = dynamic_cast<ast::Compound*>(&stmt)) {
+            for (auto& child : compound->args_) {
+                CompileStatement(*child);
+            }
+        } else if (auto* if_else = dynamic_cast<ast::IfElse*>(&stmt)) {
+            CompileIfElse(*if_else);
+        } else if (auto* ret = dynamic_cast<ast::Return*>(&stmt)) {
+            Emit(OpCode::Return, CompileOperand(*ret->statement_));
+            // Код после return недостижим, в нём любая переменная считается определённой
+            bound_.assign(bound_.size(), true);
+        } else if (auto* print = dynamic_cast<ast::Print*>(&stmt)) {
+            CompilePrint(*print);
+        } else if (auto* definition = dynamic_cast<ast::ClassDefinition*>(&stmt)) {
+            CompileClassDefinition(*definition);
+        } else if (auto* assignment = dynamic_cast<ast::Assignment*>(&stmt)) {
+            CompileAssignment(*assignment);
+        } else if (auto* field_assignment = dynamic_cast<ast::FieldAssignment*>(&stmt)) {
+            const uint32_t object = Allocate();
+            Emit(OpCode::LoadInstance, object, AddChain(field_assignment->object_.dotted_ids_));
+            const uint32_t value = CompileOperand(*field_assignment->rv_);
+            Emit(OpCode::StoreField, object, AddField(field_assignment->field_name_), value);
+        } else {
+            CompileExpression(stmt, Allocate());
+        }
+    }
+
+    // Возвращает регистр со значением выражения. Для переменной, которой
+    // заведомо присвоено значение, это её слот, иначе - новый временный регистр
+    uint32_t CompileOperand(Executable& expr) {
+        if (auto* variable = dynamic_cast<ast::VariableValue*>(&expr)) {
+            const uint32_t slot = slots_.at(variable->dotted_ids_.front());
+            if (variable->dotted_ids_.size() == 1 && bound_[slot]) {
+                return slot;
+            }
+        }
+        const uint32_t reg = Allocate();
+        CompileExpression(expr, reg);
+        return reg;
+    }
+
+    void CompileExpression(Executable& expr, uint32_t dst) {
+        RegisterScope scope(*this);
+        LocationScope location(*this, expr);
+
+        if (auto* num = dynamic_cast<ast::NumericConst*>(&expr)) {
+            // Константы не ссылаются на узлы AST: значения, записанные в переменные,
+            // должны оставаться действительны и после освобождения дерева
+            Emit(OpCode::LoadConst, dst, AddConstant(ObjectHolder::Own(num->value_)));
+        } else if (auto* str = dynamic_cast<ast::StringConst*>(&expr)) {
+            Emit(OpCode::LoadConst, dst, AddConstant(ObjectHolder::Own(str->value_)));
+        } else if (auto* boolean = dynamic_cast<ast::BoolConst*>(&expr)) {
+            Emit(OpCode::LoadConst, dst, AddConstant(ObjectHolder::Own(boolean->value_)));
+        } else if (dynamic_cast<ast::None*>(&expr)) {
+            Emit(OpCode::LoadNone, dst);
+        } else if (auto* variable = dynamic_cast<ast::VariableValue*>(&expr)) {
+            CompileVariableValue(*variable, dst);
+        } else if (auto* assignment = dynamic_cast<ast::Assignment*>(&expr)) {
+            const uint32_t slot = CompileAssignment(*assignment);
+            if (slot != dst) {
+                Emit(OpCode::Move, dst, slot);
+            }
+        } else if (auto* field_assignment = dynamic_cast<ast::FieldAssignment*>(&expr)) {
+            const uint32_t object = Allocate();
+            Emit(OpCode::LoadInstance, object, AddChain(field_assignment->object_.dotted_ids_));
+            CompileExpression(*field_assignment->rv_, dst);
+            Emit(OpCode::StoreField, object, AddField(field_assignment->field_name_), dst);
+        } else if (auto* call = dynamic_cast<ast::MethodCall*>(&expr)) {
+            CompileMethodCall(*call, dst);
+        } else if (auto* instance = dynamic_cast<ast::NewInstance*>(&expr)) {
+            CompileNewInstance(*instance, dst);
+        } else if (auto* stringify = dynamic_cast<ast::Stringify*>(&expr)) {
+            CompileUnary(*stringify, OpCode::Stringify, dst);
+        } else if (auto* negation = dynamic_cast<ast::Not*>(&expr)) {
+            CompileUnary(*negation, OpCode::Not, dst);
+        } else if (auto* add = dynamic_cast<ast::Add*>(&expr)) {
+            CompileBinary(*add, OpCode::Add, dst);
+        } else if (auto* sub = dynamic_cast<ast::Sub*>(&expr)) {
+            CompileBinary(*sub, OpCode::Sub, dst);
+        } else if (auto* mult = dynamic_cast<ast::Mult*>(&expr)) {
+            CompileBinary(*mult, OpCode::Mult, dst);
+        } else if (auto* div = dynamic_cast<ast::Div*>(&expr)) {
+            CompileBinary(*div, OpCode::Div, dst);
+        } else if (auto* disjunction = dynamic_cast<ast::Or*>(&expr)) {
+            CompileLogical(*disjunction, OpCode::JumpIfTrue, dst);
+        } else if (auto* conjunction = dynamic_cast<ast::And*>(&expr)) {
+            CompileLogical(*conjunction, OpCode::JumpIfFalse, dst);
+        } else if (auto* comparison = dynamic_cast<ast::Comparison*>(&expr)) {
+            CompileComparison(*comparison, dst);
+        } else {
+            // Узлы, не имеющие байткодового представления, исполняются деревом
+            chunk_.nodes.push_back(&expr);
+            Emit(OpCode::ExecuteNode, dst, static_cast<uint32_t>(chunk_.nodes.size() - 1));
+        }
+    }
+
+    // Значение вычисляется прямо в слот переменной: слот перезаписывается
+    // последней инструкцией выражения, поэтому rv может читать прежнее значение
+    uint32_t CompileAssignment(ast::Assignment& assignment) {
+        const uint32_t slot = slots_.at(assignment.var_);
+        CompileExpression(*assignment.rv_, slot);
+        bound_[slot] = true;
+        return slot;
+    }
+
+    void CompileIfElse(ast::IfElse& if_else) {
+        const uint32_t jump_to_else =
+            Emit(OpCode::JumpIfFalse, CompileOperand(*if_else.condition_));
+        const std::vector<bool> before = bound_;
+        CompileStatement(*if_else.if_body_);
+        std::vector<bool> after_if = before;
+        std::swap(after_if, bound_);
+        if (if_else.else_body_) {
+            const uint32_t jump_to_end = Emit(OpCode::Jump);
+            chunk_.code[jump_to_else].b = NextAddress();
+            CompileStatement(*if_else.else_body_);
+            chunk_.code[jump_to_end].a = NextAddress();
+        } else {
+            chunk_.code[jump_to_else].b = NextAddress();
+        }
+        // После ветвления переменная определена, только если она определена в обеих ветвях
+        for (size_t slot = 0; slot < bound_.size(); ++slot) {
+            bound_[slot] = bound_[slot] && after_if[slot];
+        }
+    }
+
+    void CompilePrint(ast::Print& print) {
+        for (size_t i = 0; i < print.args_.size(); ++i) {
+            RegisterScope scope(*this);
+            Emit(OpCode::PrintArg, CompileOperand(*print.args_[i]), i > 0 ? 1 : 0);
+        }
+        Emit(OpCode::PrintNewline);
+    }
+
+    void CompileClassDefinition(ast::ClassDefinition& definition) {
+        const auto* cls = definition.cls_.TryAs<runtime::Class>();
+        const uint32_t slot = slots_.at(cls->GetName());
+        Emit(OpCode::LoadConst, slot, AddConstant(definition.cls_));
+        bound_[slot] = true;
+        CompileMethods(*cls);
+    }
+
+    void CompileMethods(const runtime::Class& cls) {
+        if (!classes_->insert(&cls).second) {
+            return;
+        }
+        for (const auto& method : cls.GetMethods()) {
+            auto* body = dynamic_cast<ast::MethodBody*>(method.body.get());
+            if (body == nullptr) {
+                continue;
+            }
+            Compiler compiler(locations_);
+            body->SetCompiled(
+                std::make_unique<Code>(compiler.CompileMethod(method, *body->body_, *classes_)));
+        }
+    }
+
+    void CompileVariableValue(ast::VariableValue& variable, uint32_t dst) {
+        if (variable.dotted_ids_.size() > 1) {
+            Emit(OpCode::LoadDotted, dst, AddChain(variable.dotted_ids_));
+            return;
+        }
+        const uint32_t slot = slots_.at(variable.dotted_ids_.front());
+        if (!bound_[slot]) {
+            Emit(OpCode::LoadLocal, dst, slot);
+        } else if (slot != dst) {
+            Emit(OpCode::Move, dst, slot);
+        }
+    }
+
+    void CompileMethodCall(ast::MethodCall& call, uint32_t dst) {
+        const uint32_t object = CompileOperand(*call.object_);
+        const uint32_t site = AddCallSite(call.method_, call.args_.size());
+        Emit(OpCode::LookupMethod, dst, object, site);
+        chunk_.calls[site].args = CompileArguments(call.args_);
+        Emit(OpCode::CallMethod, dst, object, site);
+        chunk_.calls[site].skip = NextAddress();
+    }
+
+    void CompileNewInstance(ast::NewInstance& instance, uint32_t dst) {
+        // Слот переменной нельзя занять до вычисления аргументов: они могут её читать
+        const uint32_t object = dst >= first_temp_ && dst + 1 == next_register_ ? dst : Allocate();
+        Emit(OpCode::LoadConst, object,
+             AddConstant(instance.class_instance_));
+
+        // Результат __init__ не нужен
+        const uint32_t result = Allocate();
+        const uint32_t site = AddCallSite(INIT_METHOD, instance.args_.size());
+        Emit(OpCode::LookupMethod, result, object, site);
+        chunk_.calls[site].args = CompileArguments(instance.args_);
+        Emit(OpCode::CallMethod, result, object, site);
+        chunk_.calls[site].skip = NextAddress();
+
+        if (object != dst) {
+            Emit(OpCode::Move, dst, object);
+        }
+    }
+
+    // Вычисляет аргументы в подряд идущие регистры и возвращает первый из них
+    uint32_t CompileArguments(std::vector<ast::StatementPtr>& args) {
+        const uint32_t first = next_register_;
+        for (auto& arg : args) {
+            CompileExpression(*arg, Allocate());
+        }
+        return first;
+    }
+
+    void CompileUnary(ast::UnaryOperation& operation, OpCode op, uint32_t dst) {
+        Emit(op, dst, CompileOperand(*operation.argument_));
+    }
+
+    void CompileBinary(ast::BinaryOperation& operation, OpCode op, uint32_t dst) {
+        const uint32_t lhs = CompileOperand(*operation.lhs_);
+        const uint32_t rhs = CompileOperand(*operation.rhs_);
+        Emit(op, dst, lhs, rhs);
+    }
+
+    // Значение lhs, приведённое к Bool, является результатом, если по нему
+    // выполняется переход short_circuit. Иначе результатом становится приведённое значение rhs
+    void CompileLogical(ast::BinaryOperation& operation, OpCode short_circuit, uint32_t dst) {
+        // Слот переменной нельзя перезаписать до вычисления rhs: rhs может её читать
+        const uint32_t result = dst >= first_temp_ ? dst : Allocate();
+        Emit(OpCode::Truth, result, CompileOperand(*operation.lhs_));
+        const uint32_t jump_to_end = Emit(short_circuit, result);
+        {
+            RegisterScope scope(*this);
+            const std::vector<bool> before = bound_;
+            Emit(OpCode::Truth, result, CompileOperand(*operation.rhs_));
+            // rhs исполняется не всегда, поэтому присваивания в нём не учитываются
+            bound_ = before;
+        }
+        chunk_.code[jump_to_end].b = NextAddress();
+        if (result != dst) {
+            Emit(OpCode::Move, dst, result);
+        }
+    }
+
+    void CompileComparison(ast::Comparison& comparison, uint32_t dst) {
+        if (auto op = ComparisonOpCode(comparison.cmp_)) {
+            CompileBinary(comparison, *op, dst);
+            return;
+        }
+        auto& operation = static_cast<ast::BinaryOperation&>(comparison);
+        const uint32_t lhs = Allocate();
+        const uint32_t rhs = Allocate();
+        CompileExpression(*operation.lhs_, lhs);
+        CompileExpression(*operation.rhs_, rhs);
+        chunk_.comparators.push_back(comparison.cmp_);
+        Emit(OpCode::Compare, dst, lhs, static_cast<uint32_t>(chunk_.comparators.size() - 1));
+    }
+
+    uint32_t Allocate() {
+        const uint32_t reg = next_register_++;
+        max_registers_ = std::max(max_registers_, next_register_);
+        return reg;
+    }
+
+    uint32_t Emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        const bool location_changed = chunk_.locations.empty()
+                                          ? location_.IsKnown()
+                                          : chunk_.locations.back().location != location_;
+        if (location_changed) {
+            chunk_.locations.push_back(LocationEntry{NextAddress(), location_});
+        }
+        chunk_.code.push_back(Instruction{op, a, b, c});
+        return static_cast<uint32_t>(chunk_.code.size() - 1);
+    }
+
+    [[nodiscard]] uint32_t NextAddress() const {
+        return static_cast<uint32_t>(chunk_.code.size());
+    }
+
+    uint32_t AddConstant(ObjectHolder value) {
+        chunk_.constants.push_back(std::move(value));
+        return static_cast<uint32_t>(chunk_.constants.size() - 1);
+    }
+
+    uint32_t AddField(runtime::Symbol name) {
+        chunk_.fields.push_back(FieldSite{name, {}});
+        return static_cast<uint32_t>(chunk_.fields.size() - 1);
+    }
+
+    uint32_t AddChain(const std::vector<runtime::Symbol>& ids) {
+        chunk_.chains.push_back(FieldChain{slots_.at(ids.front()), ids, {}});
+        chunk_.chains.back().caches.resize(ids.size());
+        return static_cast<uint32_t>(chunk_.chains.size() - 1);
+    }
+
+    uint32_t AddCallSite(runtime::Symbol method, size_t argc) {
+        chunk_.calls.push_back(CallSite{method, static_cast<uint32_t>(argc), 0, 0, {}});
+        return static_cast<uint32_t>(chunk_.calls.size() - 1);
+    }
+
+    inline static const runtime::Symbol INIT_METHOD = "__init__"sv;
+    inline static const runtime::Symbol SELF = "self"sv;
+
+    Chunk chunk_;
+    const parse::SourceMap* locations_ = nullptr;
+    // Место программы, к которому относятся порождаемые инструкции
+    parse::SourceLocation location_;
+    std::unordered_map<runtime::Symbol, uint32_t> slots_;
+    // Для каждого слота: присвоено ли переменной значение на всех путях к текущей точке
+    std::vector<bool> bound_;
+    std::unordered_set<const runtime::Class*>* classes_ = nullptr;
+    uint32_t first_temp_ = 0;
+    uint32_t next_register_ = 0;
+    uint32_t max_registers_ = 0;
+};
+
+std::unique_ptr<Executable> Compile(std::unique_ptr<Executable> program,
+                                    const parse::SourceMap* locations) {
+    std::unordered_set<const runtime::Class*> classes;
+    Compiler compiler(locations);
+    // Узлы разобранной программы лежат в её арене, поэтому компилируется тело, а владеет
+    // им по-прежнему сама программа
+    Executable* body = program.get();
+    if (const auto* parsed = dynamic_cast<const ast::Program*>(body)) {
+        body = &parsed->GetBody();
+    }
+    Chunk chunk = compiler.CompileProgram(*body, classes);
+    return std::make_unique<Code>(std::move(chunk), std::move(program));
+}
+
+void ExecuteIncrementally(parse::Lexer& lexer, runtime::Closure& closure,
+                          runtime::Context& context) {
+    parse::SourceMap locations;
+    IncrementalParser parser(lexer, &locations);
+    // Код инструкции удаляется сразу после исполнения вместе с созданными ею объектами,
+    // на которые не осталось ссылок из переменных и полей
+    while (auto statement = parser.ParseStatement()) {
+        auto code = Compile(std::move(statement), &locations);
+        locations.Clear();
+        code->Execute(closure, context);
+    }
+}
+
+}  // namespace vm
@@ -1,10 +1,79 @@
 #include "../include/lexer.h"
+
+#include "../include/char_scan.h"
+
 #include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <istream>
+#include <thread>
+#include <utility>
 
 using namespace std;
 
 namespace parse {
 
+    namespace {
+        // Ключевые слова и их токены, перечисленные в одном порядке
+        constexpr std::array<std::string_view, 12> KEYWORDS = {
+                "class", "return", "if", "else", "def", "print",
+                "and", "or", "not", "None", "True", "False"
+        };
+
+        const std::array<Token, KEYWORDS.size()> KEYWORD_TOKENS = {
+                token_type::Class{}, token_type::Return{}, token_type::If{}, token_type::Else{},
+                token_type::Def{}, token_type::Print{}, token_type::And{}, token_type::Or{},
+                token_type::Not{}, token_type::None{}, token_type::True{}, token_type::False{}
+        };
+
+        // Совершенная хеш-функция для KEYWORDS: у разных ключевых слов значения различны,
+        // поэтому идентификатор сравнивается не более чем с одним ключевым словом.
+        // Вызывается только для непустых слов
+        constexpr size_t KEYWORD_TABLE_SIZE = 32;
+
+        constexpr size_t KeywordHash(std::string_view word) {
+            return (word.size() + static_cast<unsigned char>(word.front())
+                    + static_cast<unsigned char>(word.back())) % KEYWORD_TABLE_SIZE;
+        }
+
+        constexpr std::uint8_t NO_KEYWORD = 0xff;
+
+        constexpr std::array<std::uint8_t, KEYWORD_TABLE_SIZE> MakeKeywordTable() {
+            std::array<std::uint8_t, KEYWORD_TABLE_SIZE> table{};
+            for (auto& slot : table) {
+                slot = NO_KEYWORD;
+            }
+            for (size_t i = 0; i < KEYWORDS.size(); ++i) {
+                table[KeywordHash(KEYWORDS[i])] = static_cast<std::uint8_t>(i);
+            }
+            return table;
+        }
+
+        constexpr std::array<std::uint8_t, KEYWORD_TABLE_SIZE> KEYWORD_TABLE = MakeKeywordTable();
+
+        constexpr bool IsPerfectKeywordTable() {
+            for (size_t i = 0; i < KEYWORDS.size(); ++i) {
+                if (KEYWORD_TABLE[KeywordHash(KEYWORDS[i])] != i) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static_assert(IsPerfectKeywordTable(), "Keyword hash has collisions, choose another function");
+    }  // namespace
+
+    const Token* FindKeyword(std::string_view word) {
+        if (word.empty()) {
+            return nullptr;
+        }
+        const std::uint8_t index = KEYWORD_TABLE[KeywordHash(word)];
+        return index != NO_KEYWORD && KEYWORDS[index] == word ? &KEYWORD_TOKENS[index] : nullptr;
+    }
+
     bool operator==(const Token& lhs, const Token& rhs) {
         using namespace token_type;
 
@@ -72,54 +141,309 @@ namespace parse {
         return os << "Unknown token :("sv;
     }
 
-    Lexer::Lexer(std::istream& input): input_(input) { NextToken(); }
+    namespace {
+        template <size_t... Kinds>
+        std::array<Token, sizeof...(Kinds)> MakeValuelessTokens(std::index_sequence<Kinds...>) {
+            return {Token(std::in_place_index<Kinds>)...};
+        }
+
+        // Токены каждого вида со значением по умолчанию, индексируются TokenKind
+        const auto VALUELESS_TOKENS =
+                MakeValuelessTokens(std::make_index_sequence<std::variant_size_v<TokenBase>>{});
+    }  // namespace
 
-    const Token &Lexer::CurrentToken() const {
-        return tokinazer_.tokens_.at(index_current_token_);
+    namespace {
+        // Разбирает строки программы source, начинающиеся в [begin, end). Если last, разбирает
+        // и пустую строку в конце программы, которая закрывает отступы и добавляет Eof
+        void TokenizeLines(std::string_view source, size_t begin, size_t end, bool last,
+                           LineTokenizer& tokenizer, TokenBuffer& buffer) {
+            for (size_t offset = begin; offset < end;) {
+                const size_t line_end = source.find(NEW_LINE_SIGN, offset);
+                const size_t length = (line_end == std::string_view::npos ? source.size() : line_end + 1) - offset;
+                tokenizer.ParseLine(source.substr(offset, length), offset, buffer);
+                offset += length;
+            }
+            if (last) {
+                tokenizer.ParseLine(source.substr(source.size()), source.size(), buffer);
+            }
+        }
+
+        // Вызывает task(i) для каждого i из [0, count) в отдельном потоке.
+        // task не должна выбрасывать исключений
+        template <typename Task>
+        void RunInParallel(size_t count, Task task) {
+            std::vector<std::thread> threads;
+            threads.reserve(count - 1);
+            for (size_t i = 1; i < count; ++i) {
+                threads.emplace_back(task, i);
+            }
+            task(0);
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+        }
+    }  // namespace
+
+    TokenBuffer TokenBuffer::Tokenize(std::string_view source) {
+        TokenBuffer buffer;
+        buffer.source_ = source;
+        LineTokenizer tokenizer;
+        TokenizeLines(source, 0, source.size(), true, tokenizer, buffer);
+        return buffer;
     }
 
-    void Lexer::ParseTokens(std::istream& input){
-        LineTokenizer line;
-        for (line = LineTokenizer::ReadLine(input); line.IsEmpty(); line = LineTokenizer::ReadLine(input)){}
-        if (line.indent_ % 2 != 0) { throw LexerError("Parsing error: indentation"); }
+    TokenBuffer TokenBuffer::TokenizeParallel(std::string_view source, size_t thread_count) {
+        if (thread_count == 0) {
+            const size_t cores = std::max(1U, std::thread::hardware_concurrency());
+            thread_count = std::min(cores, source.size() / PARALLEL_CHUNK_SIZE);
+        }
+        // Каждая часть, кроме последней, заканчивается '\n'
+        std::vector<size_t> bounds{0};
+        for (size_t i = 1; i < thread_count; ++i) {
+            const size_t target = std::max(bounds.back(), source.size() / thread_count * i);
+            const size_t line_end = source.find(NEW_LINE_SIGN, target);
+            if (line_end == std::string_view::npos || line_end + 1 == source.size()) {
+                break;
+            }
+            bounds.push_back(line_end + 1);
+        }
+        bounds.push_back(source.size());
+        const size_t chunk_count = bounds.size() - 1;
+        if (chunk_count == 1) {
+            return Tokenize(source);
+        }
+
+        struct Chunk {
+            std::uint32_t first_line = 1;
+            TokenBuffer tokens;
+            std::exception_ptr error;
+            // Отступ последней строки части с токенами
+            int end_indent = 0;
+            // Начальные токены отступа, которые заменяются исправленными при слиянии
+            size_t skipped_indents = 0;
+            CompactToken indent_token;
+            size_t indent_count = 0;
+            // Положение токенов и таблиц части в общем буфере
+            size_t tokens_offset = 0;
+            size_t ids_offset = 0;
+            size_t strings_offset = 0;
+            size_t lines_offset = 0;
+        };
+        std::vector<Chunk> chunks(chunk_count);
+
+        // Номер первой строки каждой части - число '\n' перед ней
+        std::vector<std::uint32_t> line_counts(chunk_count);
+        RunInParallel(chunk_count, [&](size_t i) {
+            line_counts[i] = static_cast<std::uint32_t>(
+                    std::count(source.begin() + bounds[i], source.begin() + bounds[i + 1], NEW_LINE_SIGN));
+        });
+        for (size_t i = 1; i < chunk_count; ++i) {
+            chunks[i].first_line = chunks[i - 1].first_line + line_counts[i - 1];
+        }
+
+        // Каждая часть разбирается так, будто перед ней нет отступа
+        RunInParallel(chunk_count, [&](size_t i) {
+            Chunk& chunk = chunks[i];
+            try {
+                LineTokenizer tokenizer(chunk.first_line);
+                TokenizeLines(source, bounds[i], bounds[i + 1], i + 1 == chunk_count, tokenizer,
+                              chunk.tokens);
+                chunk.end_indent = tokenizer.CurrentIndent();
+            } catch (...) {
+                chunk.error = std::current_exception();
+            }
+        });
+        // Как и Tokenize, сообщаем о первой по тексту ошибке
+        for (const Chunk& chunk : chunks) {
+            if (chunk.error) {
+                std::rethrow_exception(chunk.error);
+            }
+        }
 
-        if (!line.IsEofOnly() && line.indent_ > current_indent_) {
-            std::vector<Token> vector_indent((line.indent_ - current_indent_) / 2, token_type::Indent{});
-            tokinazer_.tokens_.insert(tokinazer_.tokens_.end(), vector_indent.begin(), vector_indent.end());
-            current_indent_ = line.indent_;
+        // Токены отступа первой строки части с токенами исправляются по отступу в конце
+        // предыдущих частей. Отступ её строки равен удвоенному числу начальных токенов Indent,
+        // а строка из одного Eof в конце программы закрывает все отступы
+        TokenBuffer result;
+        result.source_ = source;
+        int indent = 0;
+        size_t tokens_size = 0, ids_size = 0, strings_size = 0, lines_size = 0;
+        for (Chunk& chunk : chunks) {
+            const std::vector<CompactToken>& tokens = chunk.tokens.tokens_;
+            if (!tokens.empty()) {
+                const auto first_token = std::find_if(tokens.begin(), tokens.end(),
+                                                      [](const CompactToken& token) {
+                                                          return token.kind != TokenKind::Indent;
+                                                      });
+                chunk.skipped_indents = first_token - tokens.begin();
+                const int first_indent = static_cast<int>(chunk.skipped_indents) * 2;
+                // Токены отступа занимают пробелы в начале строки
+                const std::uint32_t line_offset = chunk.tokens.lines_.front().offset;
+                const char* const line = source.data() + line_offset;
+                const auto spaces = static_cast<std::uint32_t>(
+                        SkipSpaceRun(line, source.data() + source.size()) - line);
+                chunk.indent_token = {line_offset, spaces, 0,
+                                      first_indent > indent ? TokenKind::Indent : TokenKind::Dedent};
+                chunk.indent_count = std::abs(first_indent - indent) / 2;
+                indent = chunk.end_indent;
+            }
+            chunk.tokens_offset = tokens_size;
+            chunk.ids_offset = ids_size;
+            chunk.strings_offset = strings_size;
+            chunk.lines_offset = lines_size;
+            tokens_size += chunk.indent_count + tokens.size() - chunk.skipped_indents;
+            ids_size += chunk.tokens.ids_.size();
+            strings_size += chunk.tokens.strings_.size();
+            lines_size += chunk.tokens.lines_.size();
         }
-        if (!line.IsEofOnly() && line.indent_ < current_indent_) {
-            std::vector<Token> vector_indent((current_indent_ - line.indent_) / 2, token_type::Dedent{});
-            tokinazer_.tokens_.insert(tokinazer_.tokens_.end(), vector_indent.begin(), vector_indent.end());
-            current_indent_ = line.indent_;
+        result.tokens_.resize(tokens_size);
+        result.ids_.resize(ids_size);
+        result.strings_.resize(strings_size);
+        result.lines_.resize(lines_size);
+
+        RunInParallel(chunk_count, [&](size_t i) {
+            Chunk& chunk = chunks[i];
+            TokenBuffer& tokens = chunk.tokens;
+            auto output = std::fill_n(result.tokens_.begin() + chunk.tokens_offset, chunk.indent_count,
+                                      chunk.indent_token);
+            std::transform(tokens.tokens_.begin() + chunk.skipped_indents, tokens.tokens_.end(), output,
+                           [&chunk](CompactToken token) {
+                               if (token.kind == TokenKind::Id) {
+                                   token.value += static_cast<std::int32_t>(chunk.ids_offset);
+                               } else if (token.kind == TokenKind::String) {
+                                   token.value += static_cast<std::int32_t>(chunk.strings_offset);
+                               }
+                               return token;
+                           });
+            std::copy(tokens.ids_.begin(), tokens.ids_.end(), result.ids_.begin() + chunk.ids_offset);
+            std::move(tokens.strings_.begin(), tokens.strings_.end(),
+                      result.strings_.begin() + chunk.strings_offset);
+            std::copy(tokens.lines_.begin(), tokens.lines_.end(),
+                      result.lines_.begin() + chunk.lines_offset);
+            tokens.Clear();
+        });
+        return result;
+    }
+
+    Token TokenBuffer::ToToken(size_t index) const {
+        const CompactToken& token = tokens_[index];
+        switch (token.kind) {
+            case TokenKind::Number:
+                return token_type::Number{token.value};
+            case TokenKind::Id:
+                return token_type::Id{GetId(token)};
+            case TokenKind::Char:
+                return token_type::Char{static_cast<char>(token.value)};
+            case TokenKind::String:
+                return token_type::String{GetString(token)};
+            default:
+                return VALUELESS_TOKENS[static_cast<size_t>(token.kind)];
         }
-        if (line.IsEofOnly() && current_indent_ > 0) {
-            std::vector<Token> vector_dedent(current_indent_ / 2, token_type::Dedent{});
-            tokinazer_.tokens_.insert(tokinazer_.tokens_.end(), vector_dedent.begin(), vector_dedent.end());
-            current_indent_ = line.indent_;
+    }
+
+    SourceLocation TokenBuffer::GetLocation(const CompactToken& token) const {
+        // Последняя строка, начинающаяся не позже лексемы
+        const auto next = std::upper_bound(lines_.begin(), lines_.end(), token.offset,
+                                           [](std::uint32_t offset, const LineStart& line) {
+                                               return offset < line.offset;
+                                           });
+        if (next == lines_.begin()) {
+            return {};
         }
-        tokinazer_.tokens_.insert(tokinazer_.tokens_.end(), line.tokens_.begin(), line.tokens_.end());
+        const LineStart& line = *std::prev(next);
+        return {line.line, token.offset - line.offset + 1};
     }
 
-    Token Lexer::NextToken() {
-        // Пуст или накопленные на текущей строке токены закончились
-        if (tokinazer_.tokens_.empty() || static_cast<size_t>(index_current_token_) == tokinazer_.tokens_.size() - 1) {
-            tokinazer_.tokens_.clear();
-            index_current_token_ = -1;
-            ParseTokens(input_);
+    void TokenBuffer::Clear() {
+        tokens_.clear();
+        lines_.clear();
+        ids_.clear();
+        strings_.clear();
+    }
+
+    Lexer::Lexer(std::istream& input): input_(&input) {
+        ParseTokens();
+        current_token_ = tokens_.ToToken(0);
+    }
+
+    Lexer::Lexer(std::string_view source): source_(source) {
+        ParseTokens();
+        current_token_ = tokens_.ToToken(0);
+    }
+
+    Lexer::Lexer(TokenBuffer tokens): tokens_(std::move(tokens)), batch_(true) {
+        if (tokens_.Size() > 0) {
+            current_token_ = tokens_.ToToken(0);
         }
-        return tokinazer_.tokens_.at(++index_current_token_);
     }
 
+    const Token &Lexer::CurrentToken() const {
+        return current_token_;
+    }
 
-    //TODO:: Переделать через getline
-    Lexer::LineTokenizer Lexer::LineTokenizer::ReadLine(std::istream &input) {
-        LineTokenizer line;
-        line.indent_ = SkipSpaces(input);
+    std::string_view Lexer::NextLine() {
+        if (input_ == nullptr) {
+            const size_t line_end = source_.find(NEW_LINE_SIGN);
+            const size_t length = line_end == std::string_view::npos ? source_.size() : line_end + 1;
+            const std::string_view line = source_.substr(0, length);
+            source_.remove_prefix(length);
+            return line;
+        }
+        // Буфер переиспользуется между строками, поэтому чтение строки обычно не выделяет память
+        line_buffer_.clear();
+        if (std::getline(*input_, line_buffer_) && !input_->eof()) {
+            line_buffer_.push_back(NEW_LINE_SIGN);
+        }
+        return line_buffer_;
+    }
 
+    void Lexer::ParseTokens() {
+        tokens_.Clear();
+        for (bool parsed = false; !parsed;) {
+            const size_t offset = offset_;
+            const std::string_view line = NextLine();
+            offset_ += line.size();
+            parsed = tokenizer_.ParseLine(line, offset, tokens_);
+        }
+    }
 
-        for (int ch = 0; !(ch == NEW_LINE_SIGN || ch == EOF); ) {
-            ch = input.peek();
+    SourceLocation Lexer::CurrentLocation() const {
+        if (index_current_token_ >= tokens_.Size()) {
+            return {};
+        }
+        return tokens_.GetLocation(tokens_[index_current_token_]);
+    }
+
+    Token Lexer::NextToken() {
+        if (index_current_token_ + 1 < tokens_.Size()) {
+            ++index_current_token_;
+        } else if (!batch_) {
+            // Токены текущей строки закончились
+            ParseTokens();
+            index_current_token_ = 0;
+        } else {
+            // Последний токен программы - Eof
+            return current_token_;
+        }
+        current_token_ = tokens_.ToToken(index_current_token_);
+        return current_token_;
+    }
+
+    bool LineTokenizer::ParseLine(std::string_view line, size_t offset, TokenBuffer& buffer) {
+        line_begin_ = line.data();
+        line_offset_ = offset;
+        // Пустая строка в конце программы, которая не завершается '\n', относится к последней строке
+        if (!line.empty() || line_terminated_) {
+            ++line_number_;
+            line_start_ = offset;
+        }
+        line_terminated_ = !line.empty() && line.back() == NEW_LINE_SIGN;
+        line_tokens_.clear();
+
+        std::string_view input = line;
+        const int indent = SkipSpaces(input);
+
+        while (!input.empty() && input.front() != NEW_LINE_SIGN) {
+            const char ch = input.front();
             switch (ch) {
                 case SPACE_SIGN:
                     SkipSpaces(input);
@@ -127,60 +451,105 @@ namespace parse {
                 case COMMENT_SIGN:
                     SkipComment(input);
                     break;
-                case NEW_LINE_SIGN:
-                    input.get();
-                    line.tokens_.emplace_back(token_type::Newline{});
-                    break;
-                case EOF:
-                    if (!line.IsEmpty() && !line.tokens_.back().Is<token_type::Newline>()) {
-                        line.tokens_.emplace_back(token_type::Newline{});
-                    }
-                    line.tokens_.emplace_back(token_type::Eof{});
-                    break;
                 case '"':
                 case '\'':
-                    line.tokens_.emplace_back(ParseString(input));
+                    ParseString(input, buffer);
                     break;
                 default:
-                    if (std::isdigit(ch)) {
-                        line.tokens_.emplace_back(ParseNumber(input));
-                    } else if (std::isalnum(ch) || ch == '_') {
-                        line.ParseNameOrToken(input);
+                    if (IsDigit(ch)) {
+                        ParseNumber(input);
+                    } else if (IsNameChar(ch)) {
+                        ParseNameOrToken(input, buffer);
                     } else {
-                        line.ParseComparisonOrChar(input);
+                        ParseComparisonOrChar(input);
                     }
                     break;
             }
         }
-        return line;
+
+        if (!input.empty()) {
+            Add(TokenKind::Newline, input.substr(0, 1));
+        } else {
+            // Последняя строка программы также завершается Newline, если в ней есть токены
+            if (!line_tokens_.empty()) {
+                Add(TokenKind::Newline, input);
+            }
+            Add(TokenKind::Eof, input);
+        }
+
+        const bool single = line_tokens_.size() == 1;
+        if (single && line_tokens_.front().kind == TokenKind::Newline) {
+            return false;
+        }
+        if (indent % 2 != 0) { throw Error(line.data() + indent, "Parsing error: indentation"s); }
+
+        // Токены изменения отступа относятся к пробелам в начале строки
+        const bool eof_only = single && line_tokens_.front().kind == TokenKind::Eof;
+        const CompactToken indent_token{static_cast<std::uint32_t>(offset), static_cast<std::uint32_t>(indent), 0,
+                                        TokenKind::Indent};
+        CompactToken dedent_token = indent_token;
+        dedent_token.kind = TokenKind::Dedent;
+        if (!eof_only && indent > current_indent_) {
+            buffer.tokens_.insert(buffer.tokens_.end(), (indent - current_indent_) / 2, indent_token);
+            current_indent_ = indent;
+        }
+        if (!eof_only && indent < current_indent_) {
+            buffer.tokens_.insert(buffer.tokens_.end(), (current_indent_ - indent) / 2, dedent_token);
+            current_indent_ = indent;
+        }
+        if (eof_only && current_indent_ > 0) {
+            buffer.tokens_.insert(buffer.tokens_.end(), current_indent_ / 2, dedent_token);
+            current_indent_ = 0;
+        }
+        buffer.tokens_.insert(buffer.tokens_.end(), line_tokens_.begin(), line_tokens_.end());
+        buffer.lines_.push_back({static_cast<std::uint32_t>(line_start_), line_number_});
+        return true;
+    }
+
+    LexerError LineTokenizer::Error(const char* position, const std::string& message) const {
+        return {message, {line_number_, static_cast<std::uint32_t>(position - line_begin_ + 1)}};
     }
 
-    int Lexer::LineTokenizer::SkipSpaces(std::istream &input) {
-        int space_count = 0;
-        for (; input.get() == SPACE_SIGN; ++space_count){}
-        input.unget();
-        return space_count;
+    void LineTokenizer::Add(TokenKind kind, std::string_view lexeme, std::int32_t value) {
+        const size_t offset = line_offset_ + (lexeme.data() - line_begin_);
+        line_tokens_.push_back(CompactToken{static_cast<std::uint32_t>(offset),
+                                            static_cast<std::uint32_t>(lexeme.size()), value, kind});
     }
 
-    void Lexer::LineTokenizer::SkipComment(std::istream &input) {
-        for (; !(input.get() == NEW_LINE_SIGN || input.eof());){}
-        input.unget();
+    int LineTokenizer::SkipSpaces(std::string_view &input) {
+        const char* const end = input.data() + input.size();
+        const size_t space_count = SkipSpaceRun(input.data(), end) - input.data();
+        input.remove_prefix(space_count);
+        return static_cast<int>(space_count);
     }
 
-    token_type::String Lexer::LineTokenizer::ParseString(std::istream &input) {
-        int quotation_mark = input.get();
-        auto it = std::istreambuf_iterator<char>(input);
-        auto end = std::istreambuf_iterator<char>();
-        std::string str;
+    void LineTokenizer::SkipComment(std::string_view &input) {
+        const char* const end = input.data() + input.size();
+        input.remove_prefix(FindChar(input.data(), end, NEW_LINE_SIGN) - input.data());
+    }
+
+    void LineTokenizer::ParseString(std::string_view &input, TokenBuffer& buffer) {
+        const char quotation_mark = input.front();
+        const char* it = input.data() + 1;
+        const char* const end = input.data() + input.size();
+        // Участок до первой escape-последовательности, закрывающей кавычки или конца строки
+        // копируется целиком. Для строк без escape-последовательностей это и есть значение
+        const char* plain_end = SkipStringRun(it, end);
+        while (plain_end != end && *plain_end != quotation_mark
+               && (*plain_end == '"' || *plain_end == '\'')) {
+            plain_end = SkipStringRun(plain_end + 1, end);
+        }
+        std::string str(it, plain_end);
+        it = plain_end;
         while (true) {
-            if (it == end) { throw LexerError("String parsing error"); }
+            if (it == end) { throw Error(input.data(), "String parsing error"s); }
             const char ch = *it;
             if (ch == quotation_mark) {
                 ++it;
                 break;
             } else if (ch == '\\') {
                 ++it;
-                if (it == end) { throw LexerError("String parsing error"); }
+                if (it == end) { throw Error(input.data(), "String parsing error"s); }
                 const char escaped_char = *(it);
                 switch (escaped_char) {
                     case 'n':
@@ -202,60 +571,82 @@ namespace parse {
                         str.push_back('\\');
                         break;
                     default:
-                        throw LexerError("Unrecognized escape sequence \\"s + escaped_char);
+                        throw Error(it - 1, "Unrecognized escape sequence \\"s + escaped_char);
                 }
             } else if (ch == '\n' || ch == '\r') {
-                throw LexerError("Unexpected end of line"s);
+                throw Error(it, "Unexpected end of line"s);
             } else {
-                str.push_back(ch);
+                // Обычные символы или другая кавычка копируются до следующего особого символа
+                const char* const run_end = SkipStringRun(it + 1, end);
+                str.append(it, run_end);
+                it = run_end;
+                continue;
             }
             ++it;
         }
-        return token_type::String{str};
-    }
-
-    token_type::Number Lexer::LineTokenizer::ParseNumber(std::istream &input) {
-        std::string str{static_cast<char>(input.get())};
-        for (int ch = input.get(); input && std::isdigit(ch); ch = input.get()) {
-            str += static_cast<char>(ch);
-        }
-        input.unget();
-        return token_type::Number{stoi(str)};
+        buffer.strings_.push_back(std::move(str));
+        Add(TokenKind::String, input.substr(0, it - input.data()),
+            static_cast<std::int32_t>(buffer.strings_.size() - 1));
+        input.remove_prefix(it - input.data());
     }
 
-    void Lexer::LineTokenizer::ParseNameOrToken(std::istream &input) {
-        std::string str{static_cast<char>(input.get())};
-        for (int ch = input.get(); input && (std::isalnum(ch) || ch == '_'); ch = input.get()) {
-            str.push_back(static_cast<char>(ch));
-        }
-        input.unget();
-        tokens_.emplace_back(lexemes.count(str) ? lexemes.at(str) : token_type::Id{std::move(str)} );
+    void LineTokenizer::ParseNumber(std::string_view &input) {
+        const char* const digits_end = SkipDigitRun(input.data(), input.data() + input.size());
+        int value = 0;
+        const auto [number_end, error] = std::from_chars(input.data(), digits_end, value);
+        if (error != std::errc{}) { throw Error(input.data(), "Number is out of range"s); }
+        Add(TokenKind::Number, input.substr(0, number_end - input.data()), value);
+        input.remove_prefix(number_end - input.data());
     }
 
-    void Lexer::LineTokenizer::ParseComparisonOrChar(std::istream &input) {
-        std::string sym_pair = {static_cast<char>(input.get()), static_cast<char>(input.peek())};
-        if (lexemes.count(sym_pair)) {
-            tokens_.emplace_back(lexemes.at(sym_pair));
-            input.get();
+    void LineTokenizer::ParseNameOrToken(std::string_view &input, TokenBuffer& buffer) {
+        const char* const name_end = SkipNameRun(input.data() + 1, input.data() + input.size());
+        const std::string_view name = input.substr(0, name_end - input.data());
+        if (const Token* keyword = FindKeyword(name)) {
+            Add(static_cast<TokenKind>(keyword->index()), name);
         } else {
-            tokens_.emplace_back(token_type::Char{sym_pair[0]});
+            buffer.ids_.push_back(InternName(name));
+            Add(TokenKind::Id, name, static_cast<std::int32_t>(buffer.ids_.size() - 1));
         }
+        input.remove_prefix(name.size());
     }
 
-    bool Lexer::LineTokenizer::IsEmpty() const {
-        return tokens_.empty() || std::all_of(tokens_.cbegin(), tokens_.cend(), [](const auto &t) {
-            return t.template Is<token_type::Newline>();
-        });
-    }
-
-    bool Lexer::LineTokenizer::IsEofOnly() const {
-        return tokens_.empty() || std::all_of(tokens_.cbegin(), tokens_.cend(), [](const auto &t) {
-            return t.template Is<token_type::Eof>();
-        });
+    runtime::Symbol LineTokenizer::InternName(std::string_view name) {
+        const size_t slot = (name.size() * 31 + static_cast<unsigned char>(name.front()) * 7
+                             + static_cast<unsigned char>(name.back())) % recent_names_.size();
+        runtime::Symbol& recent = recent_names_[slot];
+        if (recent.GetName() != name) {
+            recent = runtime::Symbol(name);
+        }
+        return recent;
     }
 
-    void Lexer::LineTokenizer::Reset(){
-        tokens_.clear();
-        indent_ = 0;
+    void LineTokenizer::ParseComparisonOrChar(std::string_view &input) {
+        const char ch = input[0];
+        // Все двухсимвольные операции оканчиваются на '='
+        if (input.size() > 1 && input[1] == '=') {
+            switch (ch) {
+                case '=':
+                    Add(TokenKind::Eq, input.substr(0, 2));
+                    input.remove_prefix(2);
+                    return;
+                case '!':
+                    Add(TokenKind::NotEq, input.substr(0, 2));
+                    input.remove_prefix(2);
+                    return;
+                case '<':
+                    Add(TokenKind::LessOrEq, input.substr(0, 2));
+                    input.remove_prefix(2);
+                    return;
+                case '>':
+                    Add(TokenKind::GreaterOrEq, input.substr(0, 2));
+                    input.remove_prefix(2);
+                    return;
+                default:
+                    break;
+            }
+        }
+        Add(TokenKind::Char, input.substr(0, 1), ch);
+        input.remove_prefix(1);
     }
-}  // namespace parse
\ No newline at end of file
+}  // namespace parse
@@ -1,8 +1,13 @@
+#include "../include/char_scan.h"
 #include "../include/lexer.h"
 #include "../include/test_runner_p.h"
 
+#include <cctype>
+#include <optional>
+#include <random>
 #include <sstream>
 #include <string>
+#include <vector>
 
 using namespace std;
 
@@ -77,6 +82,25 @@ void TestStrings() {
                  Token(token_type::String{"another long string with single quote ' inside"s}));
 }
 
+void TestLongStrings() {
+    // Строки длиннее блока, который сканер проверяет за раз, с особыми символами в разных местах
+    const string text(40, 'x');
+    istringstream input("'"s + text + "' \""s + text + "'\\n"s + text + "\" '"s + text
+                        + "\\\\' '\\t"s + text + "\"'\n"s);
+    Lexer lexer(input);
+
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::String{text}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{text + "'\n"s + text}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{text + "\\"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"\t"s + text + "\""s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+
+    istringstream unterminated("x = '"s + text + "\n"s);
+    ASSERT_THROWS(Lexer{unterminated}, LexerError);
+    istringstream carriage_return("x = '"s + text + "\r"s + text + "'\n"s);
+    ASSERT_THROWS(Lexer{carriage_return}, LexerError);
+}
+
 void TestOperations() {
     istringstream input("+-*/= > < != == <> <= >="s);
     Lexer lexer(input);
@@ -351,6 +375,232 @@ abc#
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
     }
 }
+
+void TestInMemorySource() {
+    const string program = R"(class Point:
+  def __init__(x, y):
+    self.x = x # comment
+    self.y = 'y\n'
+
+p = Point(1, 2)
+print p.x >= 1, p.y)"s;
+    istringstream is(program);
+    Lexer stream_lexer(is);
+    Lexer view_lexer(string_view{program});
+
+    ASSERT_EQUAL(view_lexer.CurrentToken(), stream_lexer.CurrentToken());
+    while (!stream_lexer.CurrentToken().Is<token_type::Eof>()) {
+        ASSERT_EQUAL(view_lexer.NextToken(), stream_lexer.NextToken());
+    }
+    ASSERT_EQUAL(view_lexer.NextToken(), Token(token_type::Eof{}));
+
+    Lexer empty_lexer(string_view{});
+    ASSERT_EQUAL(empty_lexer.CurrentToken(), Token(token_type::Eof{}));
+}
+
+void TestTokenBuffer() {
+    const string program = "x = 'abc'\nif x >= 12:\n  print x\n"s;
+    const TokenBuffer tokens = TokenBuffer::Tokenize(program);
+    static_assert(sizeof(CompactToken) <= 16);
+
+    const vector<pair<TokenKind, string_view>> expected = {
+        {TokenKind::Id, "x"sv},          {TokenKind::Char, "="sv},     {TokenKind::String, "'abc'"sv},
+        {TokenKind::Newline, "\n"sv},    {TokenKind::If, "if"sv},      {TokenKind::Id, "x"sv},
+        {TokenKind::GreaterOrEq, ">="sv}, {TokenKind::Number, "12"sv},  {TokenKind::Char, ":"sv},
+        {TokenKind::Newline, "\n"sv},    {TokenKind::Indent, "  "sv},  {TokenKind::Print, "print"sv},
+        {TokenKind::Id, "x"sv},          {TokenKind::Newline, "\n"sv}, {TokenKind::Dedent, ""sv},
+        {TokenKind::Eof, ""sv},
+    };
+    ASSERT_EQUAL(tokens.Size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT(tokens[i].kind == expected[i].first);
+        ASSERT_EQUAL(tokens.GetText(tokens[i]), expected[i].second);
+    }
+    ASSERT_EQUAL(tokens.GetString(tokens[2]), "abc"s);
+    ASSERT(tokens.GetId(tokens[0]) == runtime::Symbol("x"sv));
+    ASSERT_EQUAL(tokens[7].value, 12);
+    ASSERT_EQUAL(tokens.ToToken(6), Token(token_type::GreaterOrEq{}));
+
+    istringstream is(program);
+    Lexer stream_lexer(is);
+    Lexer buffer_lexer(TokenBuffer::Tokenize(program));
+    ASSERT_EQUAL(buffer_lexer.CurrentToken(), stream_lexer.CurrentToken());
+    while (!stream_lexer.CurrentToken().Is<token_type::Eof>()) {
+        ASSERT_EQUAL(buffer_lexer.NextToken(), stream_lexer.NextToken());
+    }
+    ASSERT_EQUAL(buffer_lexer.NextToken(), Token(token_type::Eof{}));
+}
+
+void TestTokenLocations() {
+    istringstream input("x = 1\n\nif x:\n  print 'a'\n"s);
+    Lexer lexer(input);
+    const vector<pair<Token, SourceLocation>> expected = {
+        {token_type::Id{"x"s}, {1, 1}},
+        {token_type::Char{'='}, {1, 3}},
+        {token_type::Number{1}, {1, 5}},
+        {token_type::Newline{}, {1, 6}},
+        {token_type::If{}, {3, 1}},
+        {token_type::Id{"x"s}, {3, 4}},
+        {token_type::Char{':'}, {3, 5}},
+        {token_type::Newline{}, {3, 6}},
+        {token_type::Indent{}, {4, 1}},
+        {token_type::Print{}, {4, 3}},
+        {token_type::String{"a"s}, {4, 9}},
+    };
+    for (const auto& [token, location] : expected) {
+        ASSERT_EQUAL(lexer.CurrentToken(), token);
+        ASSERT(lexer.CurrentLocation() == location);
+        lexer.NextToken();
+    }
+
+    const string program = "x = 1\ny = 'abc\n"s;
+    for (int batch = 0; batch < 2; ++batch) {
+        try {
+            if (batch != 0) {
+                TokenBuffer::Tokenize(program);
+            } else {
+                istringstream is(program);
+                Lexer broken(is);
+                broken.NextToken();
+                broken.NextToken();
+                broken.NextToken();
+                broken.NextToken();
+            }
+            ASSERT(false);
+        } catch (const LexerError& e) {
+            ASSERT(e.GetLocation() == (SourceLocation{2, 9}));
+            ASSERT_EQUAL(string(e.what()), "line 2, column 9: Unexpected end of line"s);
+        }
+    }
+}
+
+void TestCharScanners() {
+    const auto reference_skip = [](const string& text, size_t from, auto in_run) {
+        while (from < text.size() && in_run(static_cast<unsigned char>(text[from]))) {
+            ++from;
+        }
+        return from;
+    };
+    const auto is_name = [](unsigned char ch) {
+        return ch < 0x80 && (isalnum(ch) != 0 || ch == '_');
+    };
+    const auto is_digit = [](unsigned char ch) {
+        return ch < 0x80 && isdigit(ch) != 0;
+    };
+    const auto is_space = [](unsigned char ch) {
+        return ch == ' ';
+    };
+    // Длины участков пересекают границы 16- и 32-байтных блоков, а стоп-символы
+    // включают соседей диапазонов и байты не из ASCII
+    const string stops = "\n@[`{/:\x80\xff #("s;
+    for (size_t length = 0; length <= 70; ++length) {
+        for (const char stop : stops) {
+            const string names = string(length, 'a') + "Zz_09"s + stop + "tail"s;
+            const string digits = string(length, '7') + stop + "0123456789012345678901234567890"s;
+            const string spaces = "x"s + string(length, ' ') + stop + "                 "s;
+            const char* const name_end = SkipNameRun(names.data(), names.data() + names.size());
+            ASSERT_EQUAL(static_cast<size_t>(name_end - names.data()),
+                         reference_skip(names, 0, is_name));
+            const char* const digit_end =
+                SkipDigitRun(digits.data(), digits.data() + digits.size());
+            ASSERT_EQUAL(static_cast<size_t>(digit_end - digits.data()),
+                         reference_skip(digits, 0, is_digit));
+            const char* const space_end =
+                SkipSpaceRun(spaces.data() + 1, spaces.data() + spaces.size());
+            ASSERT_EQUAL(static_cast<size_t>(space_end - spaces.data()),
+                         reference_skip(spaces, 1, is_space));
+            // Участок до самого конца строки
+            const string run(length, '_');
+            ASSERT(SkipNameRun(run.data(), run.data() + run.size()) == run.data() + run.size());
+            ASSERT(FindChar(run.data(), run.data() + run.size(), NEW_LINE_SIGN)
+                   == run.data() + run.size());
+        }
+    }
+    for (int ch = 0; ch < 256; ++ch) {
+        ASSERT_EQUAL(IsNameChar(static_cast<char>(ch)), is_name(static_cast<unsigned char>(ch)));
+        ASSERT_EQUAL(IsDigit(static_cast<char>(ch)), is_digit(static_cast<unsigned char>(ch)));
+    }
+}
+
+// Случайная программа, корректная с точки зрения лексера, кроме редких строк с нечётным отступом
+string RandomProgram(mt19937& generator) {
+    const vector<string> words = {"class"s, "def"s, "if"s, "else"s, "return"s, "print"s,
+                                  "and"s, "or"s, "not"s, "None"s, "True"s, "False"s,
+                                  "x"s, "self"s, "value_1"s, "Shape"s, "__init__"s};
+    const vector<string> others = {"42"s, "7"s, "'text'"s, "\"a \\\"quoted\\\" word\""s,
+                                   "'tab\\t'"s, "=="s, "!="s, "<="s, ">="s, "="s, "+"s,
+                                   "("s, ")"s, ":"s, ","s, "."s};
+    const auto pick = [&generator](size_t size) {
+        return uniform_int_distribution<size_t>(0, size - 1)(generator);
+    };
+
+    string program;
+    const size_t line_count = 1 + pick(60);
+    for (size_t line = 0; line < line_count; ++line) {
+        switch (pick(8)) {
+            case 0:
+                program += string(pick(5), ' ');
+                break;
+            case 1:
+                program += string(2 * pick(5), ' ') + "# comment"s;
+                break;
+            default:
+                program += string(2 * pick(5) + (pick(200) == 0 ? 1 : 0), ' ');
+                for (size_t token = 1 + pick(6); token > 0; --token) {
+                    program += pick(2) == 0 ? words[pick(words.size())] : others[pick(others.size())];
+                    program += string(1 + pick(2), ' ');
+                }
+                break;
+        }
+        if (line + 1 < line_count || pick(2) == 0) {
+            program += '\n';
+        }
+    }
+    return program;
+}
+
+void TestParallelTokenize() {
+    mt19937 generator(20240611);
+    for (int i = 0; i < 300; ++i) {
+        const string program = RandomProgram(generator);
+
+        optional<TokenBuffer> expected;
+        string expected_error;
+        try {
+            expected = TokenBuffer::Tokenize(program);
+        } catch (const LexerError& e) {
+            expected_error = e.what();
+        }
+
+        for (const size_t threads : {2, 3, 5, 8, 16}) {
+            if (!expected) {
+                try {
+                    (void)TokenBuffer::TokenizeParallel(program, threads);
+                    ASSERT(false);
+                } catch (const LexerError& e) {
+                    ASSERT_EQUAL(string(e.what()), expected_error);
+                }
+                continue;
+            }
+            const TokenBuffer tokens = TokenBuffer::TokenizeParallel(program, threads);
+            ASSERT_EQUAL(tokens.Size(), expected->Size());
+            for (size_t t = 0; t < tokens.Size(); ++t) {
+                ASSERT(tokens[t].kind == (*expected)[t].kind);
+                ASSERT_EQUAL(tokens.GetText(tokens[t]), expected->GetText((*expected)[t]));
+                ASSERT_EQUAL(tokens.ToToken(t), expected->ToToken(t));
+                ASSERT(tokens.GetLocation(tokens[t]) == expected->GetLocation((*expected)[t]));
+            }
+
+            // Тот же поток токенов выдаёт и построчный лексер
+            Lexer lexer(program);
+            for (size_t t = 0; !lexer.CurrentToken().Is<token_type::Eof>(); ++t) {
+                ASSERT_EQUAL(lexer.CurrentToken(), tokens.ToToken(t));
+                ASSERT(lexer.CurrentLocation() == tokens.GetLocation(tokens[t]));
+                lexer.NextToken();
+            }
+        }
+    }
+}
 }  // namespace
 
 void RunOpenLexerTests(TestRunner& tr) {
@@ -359,6 +609,7 @@ void RunOpenLexerTests(TestRunner& tr) {
     RUN_TEST(tr, parse::TestNumbers);
     RUN_TEST(tr, parse::TestIds);
     RUN_TEST(tr, parse::TestStrings);
+    RUN_TEST(tr, parse::TestLongStrings);
     RUN_TEST(tr, parse::TestOperations);
     RUN_TEST(tr, parse::TestIndentsAndNewlines);
     RUN_TEST(tr, parse::TestEmptyLinesAreIgnored);
@@ -367,6 +618,11 @@ void RunOpenLexerTests(TestRunner& tr) {
     RUN_TEST(tr, parse::TestMythonProgram);
     RUN_TEST(tr, parse::TestAlwaysEmitsNewlineAtTheEndOfNonemptyLine);
     RUN_TEST(tr, parse::TestCommentsAreIgnored);
+    RUN_TEST(tr, parse::TestInMemorySource);
+    RUN_TEST(tr, parse::TestTokenBuffer);
+    RUN_TEST(tr, parse::TestTokenLocations);
+    RUN_TEST(tr, parse::TestCharScanners);
+    RUN_TEST(tr, parse::TestParallelTokenize);
 }
 
 }  // namespace parse
\ No newline at end of file
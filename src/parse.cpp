@@ -3,6 +3,10 @@
 #include "../include/lexer.h"
 #include "../include/statement.h"
 
+#include <algorithm>
+#include <functional>
+#include <utility>
+
 using namespace std;
 
 namespace TokenType = parse::token_type;
@@ -19,14 +23,17 @@ bool operator!=(const parse::Token& token, char c) {
 
 class Parser {
 public:
-    explicit Parser(parse::Lexer& lexer)
-        : lexer_(lexer) {
+    // Узлы дерева размещаются в арене arena
+    Parser(parse::Lexer& lexer, runtime::Arena& arena, runtime::Closure& declared_classes,
+           parse::SourceMap* locations = nullptr)
+        : lexer_(lexer), locations_(locations), arena_(&arena),
+          declared_classes_(declared_classes) {
     }
 
     // Program -> eps
     //          | Statement \n Program
-    unique_ptr<ast::Statement> ParseProgram() {
-        auto result = make_unique<ast::Compound>();
+    ast::StatementPtr ParseProgram() {
+        auto result = New<ast::Compound>();
         while (!lexer_.CurrentToken().Is<TokenType::Eof>()) {
             result->AddStatement(ParseStatement());
         }
@@ -34,16 +41,63 @@ public:
         return result;
     }
 
+    // Возвращает очередную инструкцию программы либо nullptr, если программа закончилась
+    ast::StatementPtr ParseNextStatement() {
+        if (lexer_.CurrentToken().Is<TokenType::Eof>()) {
+            return nullptr;
+        }
+        return ParseStatement();
+    }
+
 private:
+    template <typename Node>
+    using NodePtr = unique_ptr<Node, runtime::ExecutableDeleter>;
+
+    // Пока объект жив, парсер размещает узлы в арене arena
+    class ArenaScope {
+    public:
+        ArenaScope(Parser& parser, runtime::Arena& arena)
+            : parser_(parser), previous_(std::exchange(parser.arena_, &arena)) {
+        }
+
+        ArenaScope(const ArenaScope&) = delete;
+        ArenaScope& operator=(const ArenaScope&) = delete;
+
+        ~ArenaScope() {
+            parser_.arena_ = previous_;
+        }
+
+    private:
+        Parser& parser_;
+        runtime::Arena* previous_;
+    };
+
+    // Создаёт узел AST в текущей арене. Узлом владеет арена, а не возвращаемый указатель
+    template <typename Node, typename... Args>
+    NodePtr<Node> New(Args&&... args) {
+        return NodePtr<Node>(arena_->Make<Node>(std::forward<Args>(args)...),
+                             runtime::ExecutableDeleter::InArena());
+    }
+
+    // Создаёт узел AST и, если нужно, запоминает его положение в программе
+    template <typename Node, typename... Args>
+    NodePtr<Node> Make(parse::SourceLocation location, Args&&... args) {
+        auto node = New<Node>(std::forward<Args>(args)...);
+        if (locations_ != nullptr) {
+            locations_->Add(node.get(), location);
+        }
+        return node;
+    }
+
     // Suite -> NEWLINE INDENT (Statement)+ DEDENT
-    unique_ptr<ast::Statement> ParseSuite()  // NOLINT
+    ast::StatementPtr ParseSuite()  // NOLINT
     {
         lexer_.Expect<TokenType::Newline>();
         lexer_.ExpectNext<TokenType::Indent>();
 
         lexer_.NextToken();
 
-        auto result = make_unique<ast::Compound>();
+        auto result = New<ast::Compound>();
         while (!lexer_.CurrentToken().Is<TokenType::Dedent>()) {
             result->AddStatement(ParseStatement());  // NOLINT
         }
@@ -60,6 +114,7 @@ private:
         vector<runtime::Method> result;
 
         while (lexer_.CurrentToken().Is<TokenType::Def>()) {
+            const auto location = lexer_.CurrentLocation();
             runtime::Method m;
 
             m.name = lexer_.ExpectNext<TokenType::Id>().value;
@@ -76,7 +131,7 @@ private:
             lexer_.ExpectNext<TokenType::Char>(':');
             lexer_.NextToken();
 
-            m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+            m.body = Make<ast::MethodBody>(location, ParseSuite());  // NOLINT
 
             result.push_back(std::move(m));
         }
@@ -84,21 +139,24 @@ private:
     }
 
     // ClassDefinition -> Id ['(' Id ')'] : new_line indent MethodList dedent
-    unique_ptr<ast::Statement> ParseClassDefinition()  // NOLINT
+    ast::StatementPtr ParseClassDefinition()  // NOLINT
     {
-        string class_name = lexer_.Expect<TokenType::Id>().value;
+        const auto location = lexer_.CurrentLocation();
+        runtime::Symbol class_name = lexer_.Expect<TokenType::Id>().value;
 
         lexer_.NextToken();
 
         const runtime::Class* base_class = nullptr;
         if (lexer_.CurrentToken() == '(') {
             auto name = lexer_.ExpectNext<TokenType::Id>().value;
+            const auto name_location = lexer_.CurrentLocation();
             lexer_.ExpectNext<TokenType::Char>(')');
             lexer_.NextToken();
 
             auto it = declared_classes_.find(name);
             if (it == declared_classes_.end()) {
-                throw ParseError("Base class "s + name + " not found for class "s + class_name);
+                throw ParseError("Base class "s + name.GetName() + " not found for class "s
+                                 + class_name.GetName(), name_location);
             }
             base_class = static_cast<const runtime::Class*>(it->second.Get());  // NOLINT
         }
@@ -107,25 +165,34 @@ private:
         lexer_.ExpectNext<TokenType::Newline>();
         lexer_.ExpectNext<TokenType::Indent>();
         lexer_.ExpectNext<TokenType::Def>();
-        vector<runtime::Method> methods = ParseMethods();  // NOLINT
+        // Тела методов размещаются в собственной арене класса: класс может пережить
+        // дерево, в котором объявлен, например при исполнении программы по одной инструкции
+        auto method_storage = make_unique<runtime::Arena>();
+        vector<runtime::Method> methods;
+        {
+            ArenaScope scope(*this, *method_storage);
+            methods = ParseMethods();  // NOLINT
+        }
 
         lexer_.Expect<TokenType::Dedent>();
         lexer_.NextToken();
 
         auto [it, inserted] = declared_classes_.insert({
             class_name,
-            runtime::ObjectHolder::Own(runtime::Class(class_name, std::move(methods), base_class)),
+            runtime::ObjectHolder::Own(
+                runtime::Class(class_name.GetName(), std::move(methods), base_class,
+                               std::move(method_storage))),
         });
 
         if (!inserted) {
-            throw ParseError("Class "s + class_name + " already exists"s);
+            throw ParseError("Class "s + class_name.GetName() + " already exists"s, location);
         }
 
-        return make_unique<ast::ClassDefinition>(it->second);
+        return Make<ast::ClassDefinition>(location, it->second);
     }
 
-    vector<string> ParseDottedIds() {
-        vector<string> result(1, lexer_.Expect<TokenType::Id>().value);
+    vector<runtime::Symbol> ParseDottedIds() {
+        vector<runtime::Symbol> result(1, lexer_.Expect<TokenType::Id>().value);
 
         while (lexer_.NextToken() == '.') {
             result.push_back(lexer_.ExpectNext<TokenType::Id>().value);
@@ -136,69 +203,74 @@ private:
 
     //  AssgnOrCall -> DottedIds = Expr
     //               | DottedIds '(' ExprList ')'
-    unique_ptr<ast::Statement> ParseAssignmentOrCall() {
+    ast::StatementPtr ParseAssignmentOrCall() {
+        const auto location = lexer_.CurrentLocation();
         lexer_.Expect<TokenType::Id>();
 
-        vector<string> id_list = ParseDottedIds();
-        string last_name = id_list.back();
+        vector<runtime::Symbol> id_list = ParseDottedIds();
+        runtime::Symbol last_name = id_list.back();
         id_list.pop_back();
 
         if (lexer_.CurrentToken() == '=') {
             lexer_.NextToken();
 
             if (id_list.empty()) {
-                return make_unique<ast::Assignment>(std::move(last_name), ParseTest());
+                return Make<ast::Assignment>(location, std::move(last_name), ParseTest());
             }
-            return make_unique<ast::FieldAssignment>(ast::VariableValue{std::move(id_list)},
-                                                     std::move(last_name), ParseTest());
+            return Make<ast::FieldAssignment>(location, ast::VariableValue{std::move(id_list)},
+                                              std::move(last_name), ParseTest());
         }
         lexer_.Expect<TokenType::Char>('(');
         lexer_.NextToken();
 
         if (id_list.empty()) {
-            throw ParseError("Mython doesn't support functions, only methods: "s + last_name);
+            throw ParseError("Mython doesn't support functions, only methods: "s
+                                 + last_name.GetName(), location);
         }
 
-        vector<unique_ptr<ast::Statement>> args;
+        vector<ast::StatementPtr> args;
         if (lexer_.CurrentToken() != ')') {
             args = ParseTestList();
         }
         lexer_.Expect<TokenType::Char>(')');
         lexer_.NextToken();
 
-        return make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(std::move(id_list)),
-                                            std::move(last_name), std::move(args));
+        return Make<ast::MethodCall>(location,
+                                     Make<ast::VariableValue>(location, std::move(id_list)),
+                                     std::move(last_name), std::move(args));
     }
 
     // Expr -> Adder ['+'/'-' Adder]*
-    unique_ptr<ast::Statement> ParseExpression()  // NOLINT
+    ast::StatementPtr ParseExpression()  // NOLINT
     {
-        unique_ptr<ast::Statement> result = ParseAdder();
+        ast::StatementPtr result = ParseAdder();
         while (lexer_.CurrentToken() == '+' || lexer_.CurrentToken() == '-') {
+            const auto location = lexer_.CurrentLocation();
             char op = lexer_.CurrentToken().As<TokenType::Char>().value;
             lexer_.NextToken();
 
             if (op == '+') {
-                result = make_unique<ast::Add>(std::move(result), ParseAdder());
+                result = Make<ast::Add>(location, std::move(result), ParseAdder());
             } else {
-                result = make_unique<ast::Sub>(std::move(result), ParseAdder());
+                result = Make<ast::Sub>(location, std::move(result), ParseAdder());
             }
         }
         return result;
     }
 
     // Adder -> Mult ['*'/'/' Mult]*
-    unique_ptr<ast::Statement> ParseAdder()  // NOLINT
+    ast::StatementPtr ParseAdder()  // NOLINT
     {
-        unique_ptr<ast::Statement> result = ParseMult();
+        ast::StatementPtr result = ParseMult();
         while (lexer_.CurrentToken() == '*' || lexer_.CurrentToken() == '/') {
+            const auto location = lexer_.CurrentLocation();
             char op = lexer_.CurrentToken().As<TokenType::Char>().value;
             lexer_.NextToken();
 
             if (op == '*') {
-                result = make_unique<ast::Mult>(std::move(result), ParseMult());
+                result = Make<ast::Mult>(location, std::move(result), ParseMult());
             } else {
-                result = make_unique<ast::Div>(std::move(result), ParseMult());
+                result = Make<ast::Div>(location, std::move(result), ParseMult());
             }
         }
         return result;
@@ -213,8 +285,9 @@ private:
     //       | FALSE
     //       | DottedIds '(' ExprList ')'
     //       | DottedIds
-    unique_ptr<ast::Statement> ParseMult()  // NOLINT
+    ast::StatementPtr ParseMult()  // NOLINT
     {
+        const auto location = lexer_.CurrentLocation();
         if (lexer_.CurrentToken() == '(') {
             lexer_.NextToken();
             auto result = ParseTest();
@@ -224,40 +297,41 @@ private:
         }
         if (lexer_.CurrentToken() == '-') {
             lexer_.NextToken();
-            return make_unique<ast::Mult>(ParseMult(), make_unique<ast::NumericConst>(-1));
+            return Make<ast::Mult>(location, ParseMult(), Make<ast::NumericConst>(location, -1));
         }
         if (const auto* num = lexer_.CurrentToken().TryAs<TokenType::Number>()) {
             int result = num->value;
             lexer_.NextToken();
-            return make_unique<ast::NumericConst>(result);
+            return Make<ast::NumericConst>(location, result);
         }
         if (const auto* str = lexer_.CurrentToken().TryAs<TokenType::String>()) {
             string result = str->value;
             lexer_.NextToken();
-            return make_unique<ast::StringConst>(std::move(result));
+            return Make<ast::StringConst>(location, std::move(result));
         }
         if (lexer_.CurrentToken().Is<TokenType::True>()) {
             lexer_.NextToken();
-            return make_unique<ast::BoolConst>(runtime::Bool(true));
+            return Make<ast::BoolConst>(location, runtime::Bool(true));
         }
         if (lexer_.CurrentToken().Is<TokenType::False>()) {
             lexer_.NextToken();
-            return make_unique<ast::BoolConst>(runtime::Bool(false));
+            return Make<ast::BoolConst>(location, runtime::Bool(false));
         }
         if (lexer_.CurrentToken().Is<TokenType::None>()) {
             lexer_.NextToken();
-            return make_unique<ast::None>();
+            return Make<ast::None>(location);
         }
 
         return ParseDottedIdsInMultExpr();
     }
 
-    std::unique_ptr<ast::Statement> ParseDottedIdsInMultExpr() {
-        vector<string> names = ParseDottedIds();
+    ast::StatementPtr ParseDottedIdsInMultExpr() {
+        const auto location = lexer_.CurrentLocation();
+        vector<runtime::Symbol> names = ParseDottedIds();
 
         if (lexer_.CurrentToken() == '(') {
             // various calls
-            vector<unique_ptr<ast::Statement>> args;
+            vector<ast::StatementPtr> args;
             if (lexer_.NextToken() != ')') {
                 args = ParseTestList();
             }
@@ -268,28 +342,29 @@ private:
             names.pop_back();
 
             if (!names.empty()) {
-                return make_unique<ast::MethodCall>(
-                    make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
-                    std::move(args));
+                return Make<ast::MethodCall>(
+                    location, Make<ast::VariableValue>(location, std::move(names)),
+                    std::move(method_name), std::move(args));
             }
             if (auto it = declared_classes_.find(method_name); it != declared_classes_.end()) {
-                return make_unique<ast::NewInstance>(
-                    static_cast<const runtime::Class&>(*it->second), std::move(args));  // NOLINT
+                return Make<ast::NewInstance>(
+                    location, static_cast<const runtime::Class&>(*it->second),  // NOLINT
+                    std::move(args));
             }
-            if (method_name == "str"sv) {
+            if (method_name.GetName() == "str"sv) {
                 if (args.size() != 1) {
-                    throw ParseError("Function str takes exactly one argument"s);
+                    throw ParseError("Function str takes exactly one argument"s, location);
                 }
-                return make_unique<ast::Stringify>(std::move(args.front()));
+                return Make<ast::Stringify>(location, std::move(args.front()));
             }
-            throw ParseError("Unknown call to "s + method_name + "()"s);
+            throw ParseError("Unknown call to "s + method_name.GetName() + "()"s, location);
         }
-        return make_unique<ast::VariableValue>(std::move(names));
+        return Make<ast::VariableValue>(location, std::move(names));
     }
 
-    vector<unique_ptr<ast::Statement>> ParseTestList()  // NOLINT
+    vector<ast::StatementPtr> ParseTestList()  // NOLINT
     {
-        vector<unique_ptr<ast::Statement>> result;
+        vector<ast::StatementPtr> result;
         result.push_back(ParseTest());
 
         while (lexer_.CurrentToken() == ',') {
@@ -300,8 +375,9 @@ private:
     }
 
     // Condition -> if LogicalExpr: Suite [else: Suite]
-    unique_ptr<ast::Statement> ParseCondition()  // NOLINT
+    ast::StatementPtr ParseCondition()  // NOLINT
     {
+        const auto location = lexer_.CurrentLocation();
         lexer_.Expect<TokenType::If>();
         lexer_.NextToken();
 
@@ -312,86 +388,90 @@ private:
 
         auto if_body = ParseSuite();
 
-        unique_ptr<ast::Statement> else_body;
+        ast::StatementPtr else_body;
         if (lexer_.CurrentToken().Is<TokenType::Else>()) {
             lexer_.ExpectNext<TokenType::Char>(':');
             lexer_.NextToken();
             else_body = ParseSuite();
         }
 
-        return make_unique<ast::IfElse>(std::move(condition), std::move(if_body),
-                                        std::move(else_body));
+        return Make<ast::IfElse>(location, std::move(condition), std::move(if_body),
+                                 std::move(else_body));
     }
 
     // LogicalExpr -> AndTest [OR AndTest]
     // AndTest -> NotTest [AND NotTest]
     // NotTest -> [NOT] NotTest
     //          | Comparison
-    unique_ptr<ast::Statement> ParseTest()  // NOLINT
+    ast::StatementPtr ParseTest()  // NOLINT
     {
         auto result = ParseAndTest();
         while (lexer_.CurrentToken().Is<TokenType::Or>()) {
+            const auto location = lexer_.CurrentLocation();
             lexer_.NextToken();
-            result = make_unique<ast::Or>(std::move(result), ParseAndTest());
+            result = Make<ast::Or>(location, std::move(result), ParseAndTest());
         }
         return result;
     }
 
-    unique_ptr<ast::Statement> ParseAndTest()  // NOLINT
+    ast::StatementPtr ParseAndTest()  // NOLINT
     {
         auto result = ParseNotTest();
         while (lexer_.CurrentToken().Is<TokenType::And>()) {
+            const auto location = lexer_.CurrentLocation();
             lexer_.NextToken();
-            result = make_unique<ast::And>(std::move(result), ParseNotTest());
+            result = Make<ast::And>(location, std::move(result), ParseNotTest());
         }
         return result;
     }
 
-    unique_ptr<ast::Statement> ParseNotTest()  // NOLINT
+    ast::StatementPtr ParseNotTest()  // NOLINT
     {
         if (lexer_.CurrentToken().Is<TokenType::Not>()) {
+            const auto location = lexer_.CurrentLocation();
             lexer_.NextToken();
-            return make_unique<ast::Not>(ParseNotTest());  // NOLINT
+            return Make<ast::Not>(location, ParseNotTest());  // NOLINT
         }
         return ParseComparison();
     }
 
     // Comparison -> Expr [COMP_OP Expr]
-    unique_ptr<ast::Statement> ParseComparison()  // NOLINT
+    ast::StatementPtr ParseComparison()  // NOLINT
     {
         auto result = ParseExpression();
 
         const auto tok = lexer_.CurrentToken();
+        const auto location = lexer_.CurrentLocation();
 
         if (tok == '<') {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Less, std::move(result),
-                                                ParseExpression());
+            return Make<ast::Comparison>(location, runtime::Less, std::move(result),
+                                         ParseExpression());
         }
         if (tok == '>') {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Greater, std::move(result),
-                                                ParseExpression());
+            return Make<ast::Comparison>(location, runtime::Greater, std::move(result),
+                                         ParseExpression());
         }
         if (tok.Is<TokenType::Eq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Equal, std::move(result),
-                                                ParseExpression());
+            return Make<ast::Comparison>(location, runtime::Equal, std::move(result),
+                                         ParseExpression());
         }
         if (tok.Is<TokenType::NotEq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::NotEqual, std::move(result),
-                                                ParseExpression());
+            return Make<ast::Comparison>(location, runtime::NotEqual, std::move(result),
+                                         ParseExpression());
         }
         if (tok.Is<TokenType::LessOrEq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::LessOrEqual, std::move(result),
-                                                ParseExpression());
+            return Make<ast::Comparison>(location, runtime::LessOrEqual, std::move(result),
+                                         ParseExpression());
         }
         if (tok.Is<TokenType::GreaterOrEq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::GreaterOrEqual, std::move(result),
-                                                ParseExpression());
+            return Make<ast::Comparison>(location, runtime::GreaterOrEqual, std::move(result),
+                                         ParseExpression());
         }
         return result;
     }
@@ -399,7 +479,7 @@ private:
     // Statement -> SimpleStatement Newline
     //           | class ClassDefinition
     //           | if Condition
-    unique_ptr<ast::Statement> ParseStatement()  // NOLINT
+    ast::StatementPtr ParseStatement()  // NOLINT
     {
         const auto& tok = lexer_.CurrentToken();
 
@@ -419,30 +499,81 @@ private:
     // StatementBody -> return Expression
     //               | print ExpressionList
     //               | AssignmentOrCall
-    unique_ptr<ast::Statement> ParseSimpleStatement() {
+    ast::StatementPtr ParseSimpleStatement() {
         const auto& tok = lexer_.CurrentToken();
+        const auto location = lexer_.CurrentLocation();
 
         if (tok.Is<TokenType::Return>()) {
             lexer_.NextToken();
-            return make_unique<ast::Return>(ParseTest());
+            return Make<ast::Return>(location, ParseTest());
         }
         if (tok.Is<TokenType::Print>()) {
             lexer_.NextToken();
-            vector<unique_ptr<ast::Statement>> args;
+            vector<ast::StatementPtr> args;
             if (!lexer_.CurrentToken().Is<TokenType::Newline>()) {
                 args = ParseTestList();
             }
-            return make_unique<ast::Print>(std::move(args));
+            return Make<ast::Print>(location, std::move(args));
         }
         return ParseAssignmentOrCall();
     }
 
     parse::Lexer& lexer_;
-    runtime::Closure declared_classes_;
+    parse::SourceMap* locations_ = nullptr;
+    runtime::Arena* arena_;
+    runtime::Closure& declared_classes_;
 };
 
 }  // namespace
 
+namespace parse {
+
+SourceLocation SourceMap::Find(const runtime::Executable* node) const {
+    if (!sorted_) {
+        std::sort(entries_.begin(), entries_.end(), [](const Entry& lhs, const Entry& rhs) {
+            return std::less<>{}(lhs.first, rhs.first);
+        });
+        sorted_ = true;
+    }
+    const auto it = std::lower_bound(entries_.begin(), entries_.end(), node,
+                                     [](const Entry& entry, const runtime::Executable* key) {
+                                         return std::less<>{}(entry.first, key);
+                                     });
+    return it != entries_.end() && it->first == node ? it->second : SourceLocation{};
+}
+
+}  // namespace parse
+
 unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer) {
-    return Parser{lexer}.ParseProgram();
+    runtime::Closure declared_classes;
+    auto arena = make_unique<runtime::Arena>();
+    auto body = Parser{lexer, *arena, declared_classes}.ParseProgram();
+    return make_unique<ast::Program>(std::move(arena), std::move(body));
+}
+
+unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer, parse::SourceMap& locations) {
+    runtime::Closure declared_classes;
+    auto arena = make_unique<runtime::Arena>();
+    auto body = Parser{lexer, *arena, declared_classes, &locations}.ParseProgram();
+    return make_unique<ast::Program>(std::move(arena), std::move(body));
+}
+
+struct IncrementalParser::DeclaredClasses {
+    runtime::Closure classes;
+};
+
+IncrementalParser::IncrementalParser(parse::Lexer& lexer, parse::SourceMap* locations)
+    : lexer_(lexer), locations_(locations), declared_classes_(make_unique<DeclaredClasses>()) {
+}
+
+IncrementalParser::~IncrementalParser() = default;
+
+unique_ptr<runtime::Executable> IncrementalParser::ParseStatement() {
+    auto arena = make_unique<runtime::Arena>();
+    auto statement
+        = Parser{lexer_, *arena, declared_classes_->classes, locations_}.ParseNextStatement();
+    if (!statement) {
+        return nullptr;
+    }
+    return make_unique<ast::Program>(std::move(arena), std::move(statement));
 }
\ No newline at end of file
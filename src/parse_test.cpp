@@ -266,6 +266,29 @@ x = X(xh)
     ASSERT_EQUAL(xh->Fields().at("x"s).Get(), closure.at("x"s).Get());
 }
 
+
+void TestSourceLocations() {
+    {
+        istringstream is("x = 1\nprint x + 2\n"s);
+        Lexer lexer(is);
+        SourceMap locations;
+        auto tree = ParseProgram(lexer, locations);
+        // Assignment, NumericConst, Print, Add, VariableValue, NumericConst
+        ASSERT_EQUAL(locations.Size(), 6U);
+        ASSERT(!locations.Find(tree.get()).IsKnown());
+    }
+    try {
+        istringstream is("x = 1\n\ny = unknown(x)\n"s);
+        Lexer lexer(is);
+        SourceMap locations;
+        ParseProgram(lexer, locations);
+        ASSERT(false);
+    } catch (const ParseError& e) {
+        ASSERT(e.location == (SourceLocation{3, 5}));
+        ASSERT_EQUAL(string(e.what()), "line 3, column 5: Unknown call to unknown()"s);
+    }
+}
+
 }  // namespace parse
 
 void TestParseProgram(TestRunner& tr) {
@@ -278,4 +301,5 @@ void TestParseProgram(TestRunner& tr) {
     RUN_TEST(tr, parse::TestComplexLogicalExpression);
     RUN_TEST(tr, parse::TestClassicalPolymorphism);
     RUN_TEST(tr, parse::TestSelfInConstructor);
+    RUN_TEST(tr, parse::TestSourceLocations);
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "../include/runtime.h"
 
+#include <algorithm>
 #include <cassert>
 #include <optional>
 #include <sstream>
@@ -9,22 +10,42 @@ using namespace std;
 namespace runtime {
 
 namespace {
-    const string STRING_METHOD = "__str__"s;
-    const string LESS_METHOD = "__lt__"s;
-    const string EQUAL_METHOD = "__eq__"s;
+    const Symbol SELF = "self"sv;
+
+    struct SpecialMethodSignature {
+        Symbol name;
+        std::optional<size_t> argument_count;  // Пусто, если число параметров не ограничено
+    };
+
+    // Порядок совпадает с порядком значений SpecialMethod
+    const std::array<SpecialMethodSignature, static_cast<size_t>(SpecialMethod::Count)>
+        SPECIAL_METHODS = {{
+            {"__str__"sv, 0U},
+            {"__eq__"sv, 1U},
+            {"__lt__"sv, 1U},
+            {"__add__"sv, 1U},
+            {"__init__"sv, std::nullopt},
+        }};
 } // namespace
 
-ObjectHolder::ObjectHolder(std::shared_ptr<Object> data)
-    : data_(std::move(data)) {
+void ObjectHolder::Destroy(Object* object) noexcept {
+    HeapHeader* header = HeaderOf(object);
+    object->~Object();
+    ::operator delete(header);
 }
 
 void ObjectHolder::AssertIsValid() const {
-    assert(data_ != nullptr);
+    assert(static_cast<bool>(*this));
 }
 
-ObjectHolder ObjectHolder::Share(Object& object) {
-    // Возвращаем не владеющий shared_ptr (его deleter ничего не делает)
-    return ObjectHolder(std::shared_ptr<Object>(&object, [](auto* /*p*/) { /* do nothing */ }));
+void ObjectHolder::RetainBorrowed() {
+    // Объекты на стеке и неизменяемые строки, живущие до конца программы, остаются
+    // заимствованными
+    Object* object = Pointer();
+    if (object != nullptr && object->owned_) {
+        ++HeaderOf(object)->references;
+        SetPointer(object, OWNED);
+    }
 }
 
 ObjectHolder ObjectHolder::None() {
@@ -41,80 +62,269 @@ Object* ObjectHolder::operator->() const {
     return Get();
 }
 
-Object* ObjectHolder::Get() const {
-    return data_.get();
-}
-
-ObjectHolder::operator bool() const {
-    return Get() != nullptr;
-}
 
 bool IsTrue(const ObjectHolder& object) {
-    if (auto obj = object.TryAs<Bool>()) {
-        return obj->GetValue();
+    switch (object.GetType()) {
+        case ObjectType::Bool:
+            return object.TryAs<Bool>()->GetValue();
+        case ObjectType::Number:
+            return object.TryAs<Number>()->GetValue() != 0;
+        case ObjectType::String:
+            return !(object.TryAs<String>()->GetValue().empty());
+        default:
+            return false;
     }
-    if (auto obj = object.TryAs<Number>()) {
-        return obj->GetValue() != 0;
-    }
-    if (auto obj = object.TryAs<String>()) {
-        return !(obj->GetValue().empty());
+}
+
+ObjectHolder Stringify(const ObjectHolder& object, Context& context) {
+    // Строки не изменяются и живут до завершения программы, поэтому их можно разделять
+    static String none_string{"None"s};
+    static String bool_strings[] = {String{"False"s}, String{"True"s}};
+    static std::vector<String> small_int_strings = [] {
+        std::vector<String> strings;
+        strings.reserve(SMALL_INT_STRING_MAX - SMALL_INT_STRING_MIN + 1);
+        for (int value = SMALL_INT_STRING_MIN; value <= SMALL_INT_STRING_MAX; ++value) {
+            strings.emplace_back(std::to_string(value));
+        }
+        return strings;
+    }();
+
+    switch (object.GetType()) {
+        case ObjectType::None:
+            return ObjectHolder::Share(none_string);
+        case ObjectType::Bool:
+            return ObjectHolder::Share(bool_strings[object.TryAs<Bool>()->GetValue() ? 1 : 0]);
+        case ObjectType::Number: {
+            const int value = object.TryAs<Number>()->GetValue();
+            if (value >= SMALL_INT_STRING_MIN && value <= SMALL_INT_STRING_MAX) {
+                return ObjectHolder::Share(small_int_strings[value - SMALL_INT_STRING_MIN]);
+            }
+            return ObjectHolder::Own(String(std::to_string(value)));
+        }
+        default: {
+            std::ostringstream ss;
+            object->Print(ss, context);
+            return ObjectHolder::Own(String(ss.str()));
+        }
     }
-    return false;
 }
 
 void ClassInstance::Print(std::ostream& os, Context& context) {
-    if (HasMethod(STRING_METHOD, 0U)) {
-        Call(STRING_METHOD, {}, context)->Print(os, context);
+    if (const Method* method = cls_.GetSpecialMethod(SpecialMethod::Str)) {
+        Call(method, {}, context)->Print(os, context);
     } else {
         os << this;
     }
 }
 
-bool ClassInstance::HasMethod(const std::string& method, size_t argument_count) const {
-    auto *p_method = cls_.GetMethod(method);
-    return p_method && p_method->formal_params.size() == argument_count;
+const Method* ClassInstance::FindMethod(Symbol method, size_t argument_count) const {
+    const Method* p_method = cls_.GetMethod(method);
+    return p_method && p_method->formal_params.size() == argument_count ? p_method : nullptr;
+}
+
+bool ClassInstance::HasMethod(Symbol method, size_t argument_count) const {
+    return FindMethod(method, argument_count) != nullptr;
+}
+
+FieldTable& ClassInstance::Fields() {
+    return fields_;
+}
+
+const FieldTable& ClassInstance::Fields() const {
+    return fields_;
+}
+
+ClassInstance::ClassInstance(const Class& cls):
+    Object(ObjectType::ClassInstance), cls_(cls), fields_(cls.GetRootShape()) {}
+
+Shape::Shape(const Shape& parent, Symbol name):
+    names_(parent.names_), offsets_(parent.offsets_) {
+    offsets_.emplace(name, names_.size());
+    names_.push_back(name);
+}
+
+size_t Shape::Find(Symbol name) const {
+    auto it = offsets_.find(name);
+    return it != offsets_.end() ? it->second : NOT_FOUND;
+}
+
+const Shape* Shape::WithField(Symbol name) const {
+    auto& transition = transitions_[name];
+    if (!transition) {
+        transition.reset(new Shape(*this, name));
+    }
+    return transition.get();
+}
+
+ObjectHolder* FieldTable::Find(Symbol name, FieldCache& cache) {
+    if (cache.shape != shape_ || cache.transition) {
+        const size_t offset = shape_->Find(name);
+        if (offset == Shape::NOT_FOUND) {
+            return nullptr;
+        }
+        cache = {shape_, nullptr, offset};
+    }
+    return &values_[cache.offset];
+}
+
+ObjectHolder& FieldTable::Emplace(Symbol name, FieldCache& cache) {
+    if (cache.shape != shape_) {
+        const size_t offset = shape_->Find(name);
+        if (offset != Shape::NOT_FOUND) {
+            cache = {shape_, nullptr, offset};
+        } else {
+            cache = {shape_, shape_->WithField(name), values_.size()};
+        }
+    }
+    if (cache.transition) {
+        shape_ = cache.transition;
+        values_.emplace_back();
+    }
+    return values_[cache.offset];
+}
+
+FieldTable::iterator FieldTable::find(Symbol name) {
+    const size_t offset = shape_->Find(name);
+    return {this, offset == Shape::NOT_FOUND ? values_.size() : offset};
+}
+
+FieldTable::const_iterator FieldTable::find(Symbol name) const {
+    const size_t offset = shape_->Find(name);
+    return {this, offset == Shape::NOT_FOUND ? values_.size() : offset};
+}
+
+size_t FieldTable::count(Symbol name) const {
+    return shape_->Find(name) == Shape::NOT_FOUND ? 0 : 1;
+}
+
+ObjectHolder& FieldTable::at(Symbol name) {
+    const size_t offset = shape_->Find(name);
+    if (offset == Shape::NOT_FOUND) {
+        throw std::out_of_range("No field "s + name.GetName());
+    }
+    return values_[offset];
 }
 
-Closure& ClassInstance::Fields() {
-    return closure_;
+const ObjectHolder& FieldTable::at(Symbol name) const {
+    return const_cast<FieldTable&>(*this).at(name);
 }
 
-const Closure& ClassInstance::Fields() const {
-    return closure_;
+ObjectHolder& FieldTable::operator[](Symbol name) {
+    FieldCache cache;
+    return Emplace(name, cache);
 }
 
-ClassInstance::ClassInstance(const Class& cls): cls_(cls) {}
+ObjectHolder ClassInstance::Call(Symbol method,
+                                 const std::vector<ObjectHolder>& actual_args,
+                                 Context& context) {
+    const Method* p_method = FindMethod(method, actual_args.size());
+    if (!p_method) {
+        throw std::runtime_error("No method "s+method.GetName()+"("+std::to_string(actual_args.size())+") in class "s+cls_.GetName());
+    }
+    return Call(*p_method, actual_args, context);
+}
 
-ObjectHolder ClassInstance::Call(const std::string& method,
+ObjectHolder ClassInstance::Call(const Method& method,
                                  const std::vector<ObjectHolder>& actual_args,
                                  Context& context) {
-    if (!HasMethod(method, actual_args.size())) {
-        throw std::runtime_error("No method "s+method+"("+std::to_string(actual_args.size())+") in class "s+cls_.GetName());
+    // Аргументы копируются на стек кадров, так как actual_args изменять нельзя
+    CallFrame args(actual_args.size());
+    std::copy(actual_args.begin(), actual_args.end(), args.Slots());
+    return Call(&method, {args.Slots(), actual_args.size()}, context);
+}
+
+ObjectHolder ClassInstance::Call(const Method* method, ArgumentSpan args, Context& context) {
+    if (args.size() != method->formal_params.size()) {
+        throw std::runtime_error("Method "s + method->name.GetName() + " takes "s
+                                 + std::to_string(method->formal_params.size()) + " arguments"s);
+    }
+    CallFrame frame(method->frame_size);
+    frame[0] = ObjectHolder::Share(*this);
+    std::move(args.begin(), args.end(), frame.Slots() + 1);
+    return method->body->Call(*method, frame.Slots(), context);
+}
+
+ObjectHolder Executable::Call(const Method& method, ObjectHolder* frame, Context& context) {
+    Closure closure;
+    closure[SELF] = std::move(frame[0]);
+    for (size_t i = 0; i < method.formal_params.size(); ++i) {
+        closure[method.formal_params[i]] = std::move(frame[i + 1]);
+    }
+    return Execute(closure, context);
+}
+
+ObjectHolder* FrameStack::AcquireSlow(size_t count) {
+    for (;;) {
+        if (current_ == segments_.size()) {
+            segments_.emplace_back(std::max(SEGMENT_SIZE, count));
+        }
+        Segment& segment = segments_[current_];
+        if (segment.top + count <= segment.size) {
+            ObjectHolder* slots = segment.data.get() + segment.top;
+            segment.top += count;
+            return slots;
+        }
+        if (segment.top == 0) {
+            segment = Segment(count);
+            continue;
+        }
+        ++current_;
     }
-    auto method_ = cls_.GetMethod(method);
-    Closure args;
-    args["self"s] = ObjectHolder::Share(*this);
+}
 
-    size_t index = 0;
-    for (auto &param : method_->formal_params) {
-        args[param] = actual_args.at(index++);
+void FrameStack::Release(ObjectHolder* slots, size_t count) {
+    std::fill(slots, slots + count, ObjectHolder::None());
+    Segment& segment = segments_[current_];
+    segment.top -= count;
+    if (segment.top == 0 && current_ > 0) {
+        --current_;
     }
+}
 
-    return method_->body->Execute(args, context);
+const Method* MethodCache::Miss(const Class& cls, Symbol name,
+                                size_t argument_count) {
+#ifdef MYTHON_METHOD_CACHE_STATS
+    ++stats_.misses;
+#endif
+    const Method* method = cls.GetMethod(name);
+    if (method && method->formal_params.size() != argument_count) {
+        method = nullptr;
+    }
+    if (size_ < CAPACITY) {
+        entries_[size_++] = {&cls, method};
+    } else {
+        entries_[victim_] = {&cls, method};
+        victim_ = (victim_ + 1) % CAPACITY;
+    }
+    return method;
 }
 
-Class::Class(std::string name, std::vector<Method> methods, const Class* parent):
+Class::Class(std::string name, std::vector<Method> methods, const Class* parent,
+             std::unique_ptr<Arena> method_storage):
+        Object(ObjectType::Class),
+        method_storage_(std::move(method_storage)),
         name_(std::move(name)),
-        methods_(std::move(methods)),
-        parent_(parent) {
-    for (size_t i = 0; i < methods_.size(); ++i) {
-        methods_by_name_[methods_[i].name] = i;
+        methods_(std::move(methods)) {
+    if (parent) {
+        method_table_ = parent->method_table_;
+    }
+    method_table_.reserve(method_table_.size() + methods_.size());
+    for (Method& method : methods_) {
+        method.frame_size = method.formal_params.size() + 1;
+        method_table_[method.name] = &method;
+    }
+    for (size_t i = 0; i < SPECIAL_METHODS.size(); ++i) {
+        const auto& [special_name, argument_count] = SPECIAL_METHODS[i];
+        const Method* method = GetMethod(special_name);
+        if (method && (!argument_count || method->formal_params.size() == *argument_count)) {
+            special_methods_[i] = method;
+        }
     }
 }
 
-const Method* Class::GetMethod(const std::string& name) const {
-    return methods_by_name_.count(name) ? &methods_.at(methods_by_name_.at(name)) :
-           (parent_  ? parent_->GetMethod(name) : nullptr);
+const Method* Class::GetMethod(Symbol name) const {
+    const auto it = method_table_.find(name);
+    return it != method_table_.end() ? it->second : nullptr;
 }
 
 void Class::Print(ostream& os, [[maybe_unused]] Context& context) {
@@ -128,8 +338,11 @@ void Bool::Print(std::ostream& os, [[maybe_unused]] Context& context) {
 bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
     auto boolean = detail::BaseCompare(lhs, rhs, std::equal_to());
     if(boolean.has_value()){ return boolean.value(); }
-    if (lhs.TryAs<ClassInstance>() && lhs.TryAs<ClassInstance>()->HasMethod(EQUAL_METHOD, 1U)) {
-        return lhs.TryAs<ClassInstance>()->Call(EQUAL_METHOD, {rhs}, context).TryAs<Bool>()->GetValue();
+    auto instance = lhs.TryAs<ClassInstance>();
+    const Method* method = instance ? instance->GetClass().GetSpecialMethod(SpecialMethod::Equal) : nullptr;
+    if (method) {
+        ObjectHolder argument = rhs;
+        return instance->Call(method, {&argument, 1}, context).TryAs<Bool>()->GetValue();
     }
     if (!lhs && !rhs) {
         return true;
@@ -140,8 +353,11 @@ bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
 bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
     auto boolean = detail::BaseCompare(lhs, rhs, std::less());
     if(boolean.has_value()){ return boolean.value(); }
-    if (lhs.TryAs<ClassInstance>() && lhs.TryAs<ClassInstance>()->HasMethod(LESS_METHOD, 1U)) {
-        return lhs.TryAs<ClassInstance>()->Call(LESS_METHOD, {rhs}, context).TryAs<Bool>()->GetValue();
+    auto instance = lhs.TryAs<ClassInstance>();
+    const Method* method = instance ? instance->GetClass().GetSpecialMethod(SpecialMethod::Less) : nullptr;
+    if (method) {
+        ObjectHolder argument = rhs;
+        return instance->Call(method, {&argument, 1}, context).TryAs<Bool>()->GetValue();
     }
     throw std::runtime_error("Cannot compare objects for less"s);
 }
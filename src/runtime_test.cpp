@@ -1,6 +1,9 @@
+#include "../include/allocation_counter_p.h"
 #include "../include/runtime.h"
 #include "../include/test_runner_p.h"
 
+#include <algorithm>
+#include <array>
 #include <functional>
 
 using namespace std;
@@ -19,13 +22,13 @@ public:
     }
 
     Logger(const Logger& rhs)
-        : id_(rhs.id_)  //
+        : Object(rhs), id_(rhs.id_)  //
     {
         ++instance_count;
     }
 
     Logger(Logger&& rhs) noexcept
-        : id_(rhs.id_)  //
+        : Object(rhs), id_(rhs.id_)  //
     {
         ++instance_count;
     }
@@ -189,7 +192,8 @@ void TestNonowning() {
     }
     ASSERT_EQUAL(Logger::instance_count, 1)
 
-    auto oh = ObjectHolder::Share(logger);
+    ObjectHolder oh;
+    ASSERT_EQUAL(allocation_counter::CountAllocations([&] { oh = ObjectHolder::Share(logger); }), 0U)
     ASSERT(oh)
     ASSERT(oh.Get() == &logger)
 
@@ -199,6 +203,32 @@ void TestNonowning() {
     ASSERT_EQUAL(context.output.str(), "784"sv)
 }
 
+void TestRetain() {
+    Class cls{"Test"s, {}, nullptr};
+
+    // Ссылка self на объект в куче после Retain владеет объектом
+    ObjectHolder owner = ObjectHolder::Own(ClassInstance{cls});
+    auto* instance = owner.TryAs<ClassInstance>();
+    instance->Fields()["logger"s] = ObjectHolder::Own(Logger());
+    ObjectHolder self = ObjectHolder::Share(*instance);
+    self.Retain();
+    owner = ObjectHolder::None();
+    ASSERT_EQUAL(Logger::instance_count, 1)
+    ASSERT(self.Get() == instance)
+    self = ObjectHolder::None();
+    ASSERT_EQUAL(Logger::instance_count, 0)
+
+    // Объект на стеке и объекты других типов по-прежнему не принадлежат ссылке
+    ClassInstance on_stack{cls};
+    ObjectHolder borrowed = ObjectHolder::Share(on_stack);
+    borrowed.Retain();
+    ASSERT(borrowed.Get() == &on_stack)
+    Logger logger(1);
+    ObjectHolder logger_holder = ObjectHolder::Share(logger);
+    ASSERT_EQUAL(allocation_counter::CountAllocations([&] { logger_holder.Retain(); }), 0U)
+    ASSERT(logger_holder.Get() == &logger)
+}
+
 void TestOwning() {
     ASSERT_EQUAL(Logger::instance_count, 0)
     {
@@ -248,6 +278,61 @@ void TestNullptr() {
     ASSERT(!oh.Get())
 }
 
+void TestUnboxedValues() {
+    using allocation_counter::CountAllocations;
+
+    ObjectHolder number, copy, boolean;
+    ASSERT_EQUAL(CountAllocations([&] {
+        number = ObjectHolder::Own(Number{42});
+        copy = number;
+        boolean = ObjectHolder::Own(Bool{true});
+    }), 0U)
+    ASSERT_EQUAL(CountAllocations([] { return ObjectHolder::Own(String{"heap"s}); }), 1U)
+
+    // Копия хранит собственное значение
+    ASSERT(copy.Get() != number.Get())
+    ASSERT_EQUAL(copy.TryAs<Number>()->GetValue(), 42)
+    ASSERT(number.TryAs<ValueObject<int>>() == number.TryAs<Number>())
+    ASSERT(number.TryAs<Object>() == number.Get())
+    ASSERT(number.TryAs<Bool>() == nullptr)
+    ASSERT(boolean.TryAs<Bool>()->GetValue())
+    ASSERT(boolean.TryAs<ValueObject<bool>>() != nullptr)
+    ASSERT(boolean.TryAs<Number>() == nullptr)
+
+    ObjectHolder moved = std::move(number);
+    ASSERT_EQUAL(moved.TryAs<Number>()->GetValue(), 42)
+    ASSERT(!number)  // NOLINT
+
+    moved = boolean;
+    ASSERT(moved.TryAs<Bool>()->GetValue())
+    moved = ObjectHolder::None();
+    ASSERT(!moved)
+
+    DummyContext context;
+    copy->Print(context.output, context);
+    ASSERT_EQUAL(context.output.str(), "42"s)
+}
+
+void TestTypeTags() {
+    Class cls{"Test"s, {}, nullptr};
+    ClassInstance instance{cls};
+    Logger logger;
+
+    ASSERT(ObjectHolder().GetType() == ObjectType::None)
+    ASSERT(ObjectHolder::Own(Number{1}).GetType() == ObjectType::Number)
+    ASSERT(ObjectHolder::Own(String{"s"s}).GetType() == ObjectType::String)
+    ASSERT(ObjectHolder::Own(Bool{false}).GetType() == ObjectType::Bool)
+    ASSERT(ObjectHolder::Share(cls).GetType() == ObjectType::Class)
+    ASSERT(ObjectHolder::Share(instance).GetType() == ObjectType::ClassInstance)
+    ASSERT(ObjectHolder::Share(logger).GetType() == ObjectType::Other)
+
+    ASSERT(ObjectHolder::Share(instance).TryAs<ClassInstance>() == &instance)
+    ASSERT(ObjectHolder::Share(instance).TryAs<Class>() == nullptr)
+    ASSERT(ObjectHolder::Share(logger).TryAs<Logger>() == &logger)
+    ASSERT(ObjectHolder::Share(logger).TryAs<Number>() == nullptr)
+    ASSERT(ObjectHolder().TryAs<Number>() == nullptr)
+}
+
 void TestIsTrue() {
     {
         ASSERT(!IsTrue(ObjectHolder::Own(Bool{false})))
@@ -529,6 +614,228 @@ void TestClassInstance() {
     ASSERT_THROWS(instance.Call("missing_method"s, {}, ctx), runtime_error)
 }
 
+void TestShapes() {
+    Class cls{"Point"s, {}, nullptr};
+    ClassInstance a{cls}, b{cls}, c{cls};
+    a.Fields()["x"s] = ObjectHolder::Own(Number{1});
+    a.Fields()["y"s] = ObjectHolder::Own(Number{2});
+    b.Fields()["x"s] = ObjectHolder::Own(Number{10});
+    b.Fields()["y"s] = ObjectHolder::Own(Number{20});
+    c.Fields()["y"s] = ObjectHolder::Own(Number{100});
+    c.Fields()["x"s] = ObjectHolder::Own(Number{200});
+
+    // Одинаковые поля в одинаковом порядке дают одну форму
+    ASSERT(&a.Fields().GetShape() == &b.Fields().GetShape())
+    ASSERT(&a.Fields().GetShape() != &c.Fields().GetShape())
+    ASSERT_EQUAL(a.Fields().GetShape().Find("y"s), 1U)
+    ASSERT_EQUAL(c.Fields().GetShape().Find("y"s), 0U)
+    ASSERT_EQUAL(cls.GetRootShape().Size(), 0U)
+    ASSERT_EQUAL(b.Fields().size(), 2U)
+    ASSERT(b.Fields().find("z"s) == b.Fields().end())
+    ASSERT_EQUAL(b.Fields().find("y"s)->second.TryAs<Number>()->GetValue(), 20)
+
+    FieldCache cache;
+    ASSERT(a.Fields().Find("y"s, cache) == &a.Fields().at("y"s))
+    ASSERT(cache.shape == &a.Fields().GetShape())
+    ASSERT_EQUAL(b.Fields().Find("y"s, cache)->TryAs<Number>()->GetValue(), 20)
+    ASSERT_EQUAL(c.Fields().Find("y"s, cache)->TryAs<Number>()->GetValue(), 100)
+    FieldCache missing;
+    ASSERT(c.Fields().Find("z"s, missing) == nullptr)
+    ASSERT(missing.shape == nullptr)
+
+    // Кеш записи запоминает переход и для следующих объектов той же формы
+    ClassInstance d{cls}, e{cls};
+    FieldCache store;
+    d.Fields().Emplace("x"s, store) = ObjectHolder::Own(Number{3});
+    ASSERT(store.transition == &d.Fields().GetShape())
+    e.Fields().Emplace("x"s, store) = ObjectHolder::Own(Number{4});
+    ASSERT(&d.Fields().GetShape() == &e.Fields().GetShape())
+    ASSERT_EQUAL(e.Fields().at("x"s).TryAs<Number>()->GetValue(), 4)
+    ASSERT(&e.Fields().GetShape() == cls.GetRootShape().WithField("x"s))
+}
+
+void TestMethodTableIsFlattened() {
+    // Цепочка из восьми классов: каждый объявляет свой метод и переопределяет "name"
+    vector<unique_ptr<Class>> hierarchy;
+    for (int level = 0; level < 8; ++level) {
+        vector<Method> methods;
+        methods.push_back({"level"s + to_string(level), {}, make_unique<TestMethodBody>(nullptr)});
+        methods.push_back({"name"s, {}, make_unique<TestMethodBody>(nullptr)});
+        const Class* parent = hierarchy.empty() ? nullptr : hierarchy.back().get();
+        hierarchy.push_back(make_unique<Class>("Level"s + to_string(level), move(methods), parent));
+    }
+    const Class& root = *hierarchy.front();
+    const Class& leaf = *hierarchy.back();
+
+    // Унаследованные методы находятся в таблице потомка и указывают на методы предков
+    for (size_t level = 0; level < hierarchy.size(); ++level) {
+        const Method* method = leaf.GetMethod("level"s + to_string(level));
+        ASSERT(method != nullptr)
+        ASSERT_EQUAL(method, &hierarchy[level]->GetMethods().front())
+    }
+    ASSERT_EQUAL(leaf.GetMethod("name"s), &leaf.GetMethods().back())
+    ASSERT_EQUAL(root.GetMethod("name"s), &root.GetMethods().back())
+    ASSERT(root.GetMethod("level1"s) == nullptr)
+    ASSERT(leaf.GetMethod("missing"s) == nullptr)
+}
+
+void TestSpecialMethodSlots() {
+    vector<Method> base_methods;
+    base_methods.push_back({"__str__"s, {}, make_unique<TestMethodBody>(nullptr)});
+    base_methods.push_back({"__eq__"s, {"rhs"s}, make_unique<TestMethodBody>(nullptr)});
+    base_methods.push_back({"__init__"s, {"a"s, "b"s}, make_unique<TestMethodBody>(nullptr)});
+    Class base{"Base"s, move(base_methods), nullptr};
+
+    vector<Method> child_methods;
+    child_methods.push_back({"__str__"s, {}, make_unique<TestMethodBody>(nullptr)});
+    // Метод с неподходящим числом параметров вызывается только по имени
+    child_methods.push_back({"__lt__"s, {}, make_unique<TestMethodBody>(nullptr)});
+    child_methods.push_back({"__add__"s, {"rhs"s}, make_unique<TestMethodBody>(nullptr)});
+    Class child{"Child"s, move(child_methods), &base};
+
+    ASSERT_EQUAL(base.GetSpecialMethod(SpecialMethod::Str), base.GetMethod("__str__"s))
+    ASSERT_EQUAL(base.GetSpecialMethod(SpecialMethod::Init), base.GetMethod("__init__"s))
+    ASSERT(base.GetSpecialMethod(SpecialMethod::Add) == nullptr)
+
+    ASSERT_EQUAL(child.GetSpecialMethod(SpecialMethod::Str), child.GetMethod("__str__"s))
+    ASSERT(child.GetSpecialMethod(SpecialMethod::Str) != base.GetSpecialMethod(SpecialMethod::Str))
+    ASSERT_EQUAL(child.GetSpecialMethod(SpecialMethod::Equal), base.GetMethod("__eq__"s))
+    ASSERT_EQUAL(child.GetSpecialMethod(SpecialMethod::Init), base.GetMethod("__init__"s))
+    ASSERT_EQUAL(child.GetSpecialMethod(SpecialMethod::Add), child.GetMethod("__add__"s))
+    ASSERT(child.GetSpecialMethod(SpecialMethod::Less) == nullptr)
+    ASSERT(child.GetMethod("__lt__"s) != nullptr)
+}
+
+void TestMethodCache() {
+    vector<Method> base_methods;
+    base_methods.push_back({"get"s, {}, make_unique<TestMethodBody>(nullptr)});
+    base_methods.push_back({"set"s, {"value"s}, make_unique<TestMethodBody>(nullptr)});
+    Class base{"Base"s, move(base_methods), nullptr};
+
+    vector<Method> child_methods;
+    child_methods.push_back({"get"s, {}, make_unique<TestMethodBody>(nullptr)});
+    Class child{"Child"s, move(child_methods), &base};
+    Class other{"Other"s, {}, nullptr};
+
+    [[maybe_unused]] auto& stats = MethodCache::Stats();
+    [[maybe_unused]] const MethodCacheStats before = stats;
+
+    MethodCache get;
+    ASSERT_EQUAL(get.Lookup(base, "get"s, 0), base.GetMethod("get"s))
+    ASSERT_EQUAL(get.Lookup(child, "get"s, 0), child.GetMethod("get"s))
+    ASSERT(get.Lookup(other, "get"s, 0) == nullptr)
+#ifdef MYTHON_METHOD_CACHE_STATS
+    ASSERT_EQUAL(stats.misses - before.misses, 3U)
+    ASSERT_EQUAL(stats.hits - before.hits, 0U)
+#endif
+
+    // Повторные вызовы, в том числе для класса без метода, не ищут метод заново
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQUAL(get.Lookup(child, "get"s, 0), child.GetMethod("get"s))
+        ASSERT(get.Lookup(other, "get"s, 0) == nullptr)
+    }
+#ifdef MYTHON_METHOD_CACHE_STATS
+    ASSERT_EQUAL(stats.misses - before.misses, 3U)
+    ASSERT_EQUAL(stats.hits - before.hits, 20U)
+#else
+    // Без счётчиков попадания и промахи не отражаются на статистике
+    ASSERT_EQUAL(stats.misses, 0U)
+    ASSERT_EQUAL(stats.hits, 0U)
+#endif
+    ASSERT_EQUAL(get.Peek(base), base.GetMethod("get"s))
+
+    // Унаследованный метод с неподходящим числом параметров не находится
+    MethodCache set;
+    ASSERT_EQUAL(set.Lookup(child, "set"s, 1), base.GetMethod("set"s))
+    MethodCache set_without_args;
+    ASSERT(set_without_args.Lookup(child, "set"s, 0) == nullptr)
+
+    // При переполнении кеш вытесняет старые записи, но остаётся корректным
+    vector<unique_ptr<Class>> classes;
+    MethodCache megamorphic;
+    for (size_t i = 0; i < MethodCache::CAPACITY * 2; ++i) {
+        classes.push_back(make_unique<Class>("Derived"s + to_string(i), vector<Method>{}, &base));
+        ASSERT_EQUAL(megamorphic.Lookup(*classes.back(), "get"s, 0), base.GetMethod("get"s))
+    }
+    ASSERT(megamorphic.Peek(*classes.front()) == nullptr)
+    ASSERT_EQUAL(megamorphic.Lookup(*classes.front(), "get"s, 0), base.GetMethod("get"s))
+}
+
+
+void TestSymbols() {
+    using allocation_counter::CountAllocations;
+
+    const Symbol name = "interned_symbol_name"s;
+    const string copy = "interned_symbol_"s + "name"s;
+    ASSERT(Symbol(copy) == name)
+    ASSERT(&Symbol(copy).GetName() == &name.GetName())
+    ASSERT_EQUAL(std::hash<Symbol>{}(copy), std::hash<string_view>{}(copy))
+    ASSERT(Symbol("other_symbol_name"sv) != name)
+    ASSERT(Symbol() == Symbol(""sv))
+
+    // Уже известное имя повторно в таблицу не добавляется
+    ASSERT_EQUAL(CountAllocations([&] { return Symbol(string_view{copy}); }), 0U)
+
+    Closure closure;
+    closure[name] = ObjectHolder::Own(Number(1));
+    ASSERT_EQUAL(closure.count(copy), 1U)
+    ASSERT_EQUAL(CountAllocations([&] { return closure.find(name); }), 0U)
+}
+
+void TestArena() {
+    using allocation_counter::CountAllocations;
+
+    // Объекты с деструкторами разрушаются вместе с ареной в порядке, обратном созданию
+    struct Tracked {
+        Tracked(vector<int>* destroyed, int id): destroyed(destroyed), id(id) {
+        }
+
+        Tracked(const Tracked&) = delete;
+        Tracked& operator=(const Tracked&) = delete;
+
+        ~Tracked() {
+            destroyed->push_back(id);
+        }
+
+        vector<int>* destroyed;
+        int id;
+    };
+    vector<int> destroyed;
+    {
+        Arena arena;
+        for (int i = 0; i < 1000; ++i) {
+            ASSERT_EQUAL(arena.Make<Tracked>(&destroyed, i)->id, i)
+        }
+        ASSERT(destroyed.empty())
+    }
+    ASSERT_EQUAL(destroyed.size(), 1000U)
+    ASSERT(std::is_sorted(destroyed.rbegin(), destroyed.rend()))
+
+    Arena arena;
+    // Объекты выравниваются по требованию своего типа
+    struct alignas(64) Aligned {
+        char value;
+    };
+    for (int i = 0; i < 100; ++i) {
+        arena.Make<char>('x');
+        ASSERT_EQUAL(reinterpret_cast<uintptr_t>(arena.Make<Aligned>()) % alignof(Aligned), 0U)
+        ASSERT_EQUAL(reinterpret_cast<uintptr_t>(arena.Make<double>(1.0)) % alignof(double), 0U)
+    }
+
+    // Объект больше блока получает собственный блок
+    auto* big = arena.Make<array<char, 100000>>();
+    big->fill('a');
+    ASSERT(arena.GetReservedBytes() >= sizeof(*big))
+
+    // Мелкие объекты размещаются в общих блоках, а не по одному
+    const size_t allocations = CountAllocations([&] {
+        for (int i = 0; i < 10000; ++i) {
+            arena.Make<int>(i);
+        }
+    });
+    ASSERT(allocations < 10U)
+}
+
 }  // namespace
 
 void RunObjectsTests(TestRunner& tr) {
@@ -540,13 +847,22 @@ void RunObjectsTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestComparison);
     RUN_TEST(tr, runtime::TestClass);
     RUN_TEST(tr, runtime::TestClassInstance);
+    RUN_TEST(tr, runtime::TestShapes);
+    RUN_TEST(tr, runtime::TestMethodTableIsFlattened);
+    RUN_TEST(tr, runtime::TestSpecialMethodSlots);
+    RUN_TEST(tr, runtime::TestMethodCache);
+    RUN_TEST(tr, runtime::TestSymbols);
+    RUN_TEST(tr, runtime::TestArena);
 }
 
 void RunObjectHolderTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestNonowning);
+    RUN_TEST(tr, runtime::TestRetain);
     RUN_TEST(tr, runtime::TestOwning);
     RUN_TEST(tr, runtime::TestMove);
     RUN_TEST(tr, runtime::TestNullptr);
+    RUN_TEST(tr, runtime::TestUnboxedValues);
+    RUN_TEST(tr, runtime::TestTypeTags);
 }
  
 }  // namespace runtime
\ No newline at end of file
@@ -11,34 +11,47 @@ using runtime::Context;
 using runtime::ObjectHolder;
 
 namespace {
-const string ADD_METHOD = "__add__"s;
-const string INIT_METHOD = "__init__"s;
 const string ERROR_OPERATION = "Error: the operation cannot be performed: "s;
 }  // namespace
 
 ObjectHolder Assignment::Execute(Closure& closure, Context& context) {
-    closure[var_] = rv_->Execute(closure, context); // ?
-    return closure.at(var_);
+    ObjectHolder value = rv_->Execute(closure, context);
+    value.Retain();
+    return closure[var_] = std::move(value);
 }
 
-Assignment::Assignment(std::string var, std::unique_ptr<Statement> rv):
-    var_(std::move(var)), rv_(move(rv)) {
+Assignment::Assignment(runtime::Symbol var, StatementPtr rv):
+    var_(var), rv_(move(rv)) {
 }
 
-VariableValue::VariableValue(const std::string& var_name): dotted_ids_{var_name} {
+VariableValue::VariableValue(runtime::Symbol var_name):
+    dotted_ids_{var_name}, field_caches_(1) {
 }
 
-VariableValue::VariableValue(std::vector<std::string> dotted_ids): dotted_ids_(move(dotted_ids)) {
+VariableValue::VariableValue(std::vector<runtime::Symbol> dotted_ids):
+    dotted_ids_(move(dotted_ids)), field_caches_(dotted_ids_.size()) {
+}
+
+VariableValue::VariableValue(const std::vector<std::string>& dotted_ids):
+    VariableValue(std::vector<runtime::Symbol>(dotted_ids.begin(), dotted_ids.end())) {
 }
 
 ObjectHolder VariableValue::Execute(Closure& closure, Context& /*context*/) {
     ObjectHolder result;
-    Closure* p_closure = &closure;
-    for (const auto &id : dotted_ids_) {
-        if (!p_closure->count(id)) { throw runtime_error("Uncknown : " + GetStrDottedIds()); }
-        result = p_closure->at(id);
-        if (result.TryAs<runtime::ClassInstance>()) {
-            p_closure = &result.TryAs<runtime::ClassInstance>()->Fields();
+    runtime::FieldTable* fields = nullptr;
+    for (size_t i = 0; i < dotted_ids_.size(); ++i) {
+        // Пока не встретился объект, имена ищутся в closure
+        if (fields) {
+            auto* value = fields->Find(dotted_ids_[i], field_caches_[i]);
+            if (!value) { throw runtime_error("Uncknown : " + GetStrDottedIds()); }
+            result = *value;
+        } else {
+            auto it = closure.find(dotted_ids_[i]);
+            if (it == closure.end()) { throw runtime_error("Uncknown : " + GetStrDottedIds()); }
+            result = it->second;
+        }
+        if (auto* instance = result.TryAs<runtime::ClassInstance>()) {
+            fields = &instance->Fields();
         }
     }
     return result;
@@ -47,7 +60,7 @@ ObjectHolder VariableValue::Execute(Closure& closure, Context& /*context*/) {
 std::string VariableValue::GetStrDottedIds() {
     static const char* const delim = ", ";
     std::ostringstream imploded;
-    std::copy(dotted_ids_.begin(), dotted_ids_.end(), std::ostream_iterator<std::string>(imploded, delim));
+    std::copy(dotted_ids_.begin(), dotted_ids_.end(), std::ostream_iterator<runtime::Symbol>(imploded, delim));
     return imploded.str();
 }
 
@@ -55,11 +68,11 @@ unique_ptr<Print> Print::Variable(const std::string& name) {
     return make_unique<Print>(make_unique<VariableValue>(name));
 }
 
-Print::Print(unique_ptr<Statement> argument) {
+Print::Print(StatementPtr argument) {
     args_.push_back(std::move(argument));
 }
 
-Print::Print(vector<unique_ptr<Statement>> args): args_(std::move(args)) {
+Print::Print(vector<StatementPtr> args): args_(std::move(args)) {
 }
 
 ObjectHolder Print::Execute(Closure& closure, Context& context) {
@@ -77,34 +90,27 @@ ObjectHolder Print::Execute(Closure& closure, Context& context) {
     return {};
 }
 
-MethodCall::MethodCall(std::unique_ptr<Statement> object, std::string method,
-                       std::vector<std::unique_ptr<Statement>> args):
-                       object_{std::move(object)}, method_{std::move(method)},
+MethodCall::MethodCall(StatementPtr object, runtime::Symbol method,
+                       std::vector<StatementPtr> args):
+                       object_{std::move(object)}, method_{method},
                        args_{std::move(args)} {
 
 }
 
 ObjectHolder MethodCall::Execute(Closure& closure, Context& context) {
     auto instance  = object_->Execute(closure, context).TryAs<runtime::ClassInstance>();
-    if (instance->HasMethod(method_, args_.size())) {
-        std::vector<runtime::ObjectHolder> args(args_.size());
+    if (auto method = method_cache_.Lookup(instance->GetClass(), method_, args_.size())) {
+        runtime::CallFrame args(args_.size());
         std::transform(args_.cbegin(), args_.cend(),
-                       args.begin(),
+                       args.Slots(),
                        [&](const auto& arg){ return arg->Execute(closure, context); });
-        return instance->Call(method_, args, context);
+        return instance->Call(method, {args.Slots(), args_.size()}, context);
     }
     return {};
 }
 
 ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
-    auto holder = argument_->Execute(closure, context);
-    if (holder) {
-        std::stringstream ss;
-        holder->Print(ss, context);
-        return ObjectHolder::Own(runtime::String(ss.str()));
-    } else {
-        return ObjectHolder::Own(runtime::String("None"));
-    }
+    return runtime::Stringify(argument_->Execute(closure, context), context);
 }
 
 namespace {
@@ -123,7 +129,10 @@ ObjectHolder Add::Execute(Closure& closure, Context& context) {
         return ObjectHolder::Own(runtime::String(lhs.TryAs<runtime::String>()->GetValue() + rhs.TryAs<runtime::String>()->GetValue()));
     }
     if (const auto left_instance = lhs.TryAs<runtime::ClassInstance>()) {
-        return left_instance->Call(ADD_METHOD, {rhs}, context);
+        const auto method = left_instance->GetClass().GetSpecialMethod(runtime::SpecialMethod::Add);
+        if (method) {
+            return left_instance->Call(method, {&rhs, 1}, context);
+        }
     }
     throw std::runtime_error(ERROR_OPERATION + "Add"s);
 }
@@ -149,14 +158,27 @@ ObjectHolder Div::Execute(Closure& closure, Context& context) {
 #undef NUM_BINARY_OPERATION
 
 ObjectHolder Compound::Execute(Closure& closure, Context& context) {
-    for (const auto &stmt: args_) {
-        stmt->Execute(closure, context);
-    }
+    ObjectHolder result;
+    ExecuteFlow(closure, context, result);
     return ObjectHolder::None();
 }
 
+bool Compound::ExecuteFlow(Closure& closure, Context& context, ObjectHolder& result) {
+    for (size_t i = 0; i < args_.size(); ++i) {
+        if (ast::ExecuteFlow(*args_[i], flows_[i], closure, context, result)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 ObjectHolder Return::Execute(Closure& closure, Context& context) {
-    throw statement_->Execute(closure, context);
+    return statement_->Execute(closure, context);
+}
+
+bool Return::ExecuteFlow(Closure& closure, Context& context, ObjectHolder& result) {
+    result = statement_->Execute(closure, context);
+    return true;
 }
 
 ClassDefinition::ClassDefinition(ObjectHolder cls): cls_(std::move(cls)) {
@@ -167,21 +189,26 @@ ObjectHolder ClassDefinition::Execute(Closure& closure, Context& /*context*/) {
     return ObjectHolder::None();
 }
 
-FieldAssignment::FieldAssignment(VariableValue object, std::string field_name,
-                                 std::unique_ptr<Statement> rv):
-                                 object_(std::move(object)), field_name_(std::move(field_name)),rv_(std::move(rv)) {
+FieldAssignment::FieldAssignment(VariableValue object, runtime::Symbol field_name,
+                                 StatementPtr rv):
+                                 object_(std::move(object)), field_name_(field_name),rv_(std::move(rv)) {
 }
 
 ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context) {
     auto obj = object_.Execute(closure, context).TryAs<runtime::ClassInstance>();
-    if (obj) { return obj->Fields()[field_name_] = rv_->Execute(closure, context); }
+    if (obj) {
+        auto value = rv_->Execute(closure, context);
+        value.Retain();
+        return obj->Fields().Emplace(field_name_, field_cache_) = std::move(value);
+    }
     throw runtime_error("Error: is not class"s);
 }
 
-IfElse::IfElse(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> if_body,
-               std::unique_ptr<Statement> else_body):
+IfElse::IfElse(StatementPtr condition, StatementPtr if_body, StatementPtr else_body):
                condition_(std::move(condition)), if_body_(std::move(if_body)),
-               else_body_(std::move(else_body)) {
+               else_body_(std::move(else_body)),
+               if_flow_(dynamic_cast<ControlFlow*>(if_body_.get())),
+               else_flow_(dynamic_cast<ControlFlow*>(else_body_.get())) {
 }
 
 ObjectHolder IfElse::Execute(Closure& closure, Context& context) {
@@ -193,16 +220,34 @@ ObjectHolder IfElse::Execute(Closure& closure, Context& context) {
     return runtime::ObjectHolder::None();
 }
 
+bool IfElse::ExecuteFlow(Closure& closure, Context& context, ObjectHolder& result) {
+    if (runtime::IsTrue(condition_->Execute(closure, context))) {
+        return ast::ExecuteFlow(*if_body_, if_flow_, closure, context, result);
+    } else if (else_body_) {
+        return ast::ExecuteFlow(*else_body_, else_flow_, closure, context, result);
+    }
+    return false;
+}
+
+namespace {
+    // Приводит операнд логической операции к bool. None операндом быть не может
+    bool LogicalOperand(Statement& operand, Closure& closure, Context& context) {
+        auto value = operand.Execute(closure, context);
+        if (!value) { throw runtime_error("Invalid arguments"); }
+        return IsTrue(value);
+    }
+}  // namespace
+
 ObjectHolder Or::Execute(Closure& closure, Context& context) {
-    auto lhs = lhs_->Execute(closure, context), rhs = rhs_->Execute(closure, context);
-    if (lhs && rhs) { return ObjectHolder::Own(runtime::Bool{IsTrue(lhs) || IsTrue(rhs)}); }
-    throw runtime_error("Invalid arguments");
+    const bool result = LogicalOperand(*lhs_, closure, context)
+                        || LogicalOperand(*rhs_, closure, context);
+    return ObjectHolder::Own(runtime::Bool{result});
 }
 
 ObjectHolder And::Execute(Closure& closure, Context& context) {
-    auto lhs = lhs_->Execute(closure, context), rhs = rhs_->Execute(closure, context);
-    if (lhs && rhs) { return ObjectHolder::Own(runtime::Bool{IsTrue(lhs) && IsTrue(rhs)}); }
-    throw runtime_error("Invalid arguments");
+    const bool result = LogicalOperand(*lhs_, closure, context)
+                        && LogicalOperand(*rhs_, closure, context);
+    return ObjectHolder::Own(runtime::Bool{result});
 }
 
 ObjectHolder Not::Execute(Closure& closure, Context& context) {
@@ -211,7 +256,7 @@ ObjectHolder Not::Execute(Closure& closure, Context& context) {
     throw runtime_error("Invalid arguments");
 }
 
-Comparison::Comparison(Comparator cmp, unique_ptr<Statement> lhs, unique_ptr<Statement> rhs)
+Comparison::Comparison(Comparator cmp, StatementPtr lhs, StatementPtr rhs)
     : BinaryOperation(std::move(lhs), std::move(rhs)), cmp_(std::move(cmp)) {
 
 }
@@ -221,34 +266,50 @@ ObjectHolder Comparison::Execute(Closure& closure, Context& context) {
     return ObjectHolder::Own(runtime::Bool{cmp_(lhs, rhs, context)});
 }
 
-NewInstance::NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args):
-    class_instance_(class_), args_(std::move(args)){
+NewInstance::NewInstance(const runtime::Class& class_, std::vector<StatementPtr> args):
+    class_instance_(ObjectHolder::Own(runtime::ClassInstance(class_))), args_(std::move(args)){
 }
 
-NewInstance::NewInstance(const runtime::Class& class_): class_instance_(class_) {
+NewInstance::NewInstance(const runtime::Class& class_):
+    class_instance_(ObjectHolder::Own(runtime::ClassInstance(class_))) {
 }
 
 ObjectHolder NewInstance::Execute(Closure& closure, Context& context) {
-    if (class_instance_.HasMethod(INIT_METHOD, args_.size())) {
-        std::vector<runtime::ObjectHolder> actual_args(args_.size());
+    auto& instance = *class_instance_.TryAs<runtime::ClassInstance>();
+    const auto method = instance.GetClass().GetSpecialMethod(runtime::SpecialMethod::Init);
+    if (method && method->formal_params.size() == args_.size()) {
+        runtime::CallFrame actual_args(args_.size());
         std::transform(args_.cbegin(), args_.cend(),
-                       actual_args.begin(),
+                       actual_args.Slots(),
                        [&](const auto& arg){ return arg->Execute(closure, context); });
-        class_instance_.Call(INIT_METHOD, actual_args, context);
+        instance.Call(method, {actual_args.Slots(), args_.size()}, context);
     }
-    return runtime::ObjectHolder::Share(class_instance_);
+    return class_instance_;
+}
+
+MethodBody::MethodBody(StatementPtr&& body):
+    body_(std::move(body)), body_flow_(dynamic_cast<ControlFlow*>(body_.get())) {
 }
 
-MethodBody::MethodBody(std::unique_ptr<Statement>&& body): body_(std::move(body)) {
+void MethodBody::SetCompiled(std::unique_ptr<Statement> compiled) {
+    compiled_ = std::move(compiled);
+}
+
+ObjectHolder MethodBody::Call(const runtime::Method& method, ObjectHolder* frame,
+                              Context& context) {
+    if (compiled_) {
+        return compiled_->Call(method, frame, context);
+    }
+    return Statement::Call(method, frame, context);
 }
 
 ObjectHolder MethodBody::Execute(Closure& closure, Context& context) {
-    try {
-        body_->Execute(closure, context);
-        return runtime::ObjectHolder::None();
-    }  catch (runtime::ObjectHolder& result) {
-        return result;
-    }  catch (...) { throw; }
+    if (compiled_) {
+        return compiled_->Execute(closure, context);
+    }
+    ObjectHolder result;
+    ast::ExecuteFlow(*body_, body_flow_, closure, context, result);
+    return result;
 }
 
 }  // namespace ast
\ No newline at end of file
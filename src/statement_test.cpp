@@ -1,3 +1,4 @@
+#include "../include/allocation_counter_p.h"
 #include "../include/statement.h"
 #include "../include/test_runner_p.h"
 
@@ -161,7 +162,7 @@ void TestPrintMultipleStatements() {
     runtime::String hello("hello"s);
     Closure closure = {{"word"s, ObjectHolder::Share(hello)}, {"empty"s, ObjectHolder::None()}};
 
-    vector<unique_ptr<Statement>> args;
+    vector<StatementPtr> args;
     args.push_back(make_unique<VariableValue>("word"s));
     args.push_back(make_unique<NumericConst>(57));
     args.push_back(make_unique<StringConst>("Python"s));
@@ -439,6 +440,50 @@ void TestAnd() {
     test_and(false, false);
 }
 
+void TestLogicalShortCircuit() {
+    // Считает, сколько раз был вычислен правый операнд
+    struct CountingStatement : Statement {
+        explicit CountingStatement(bool value)
+            : value(value) {
+        }
+
+        ObjectHolder Execute(Closure& /*closure*/, runtime::Context& /*context*/) override {
+            ++executions;
+            return ObjectHolder::Own(runtime::Bool(value));
+        }
+
+        bool value;
+        int executions = 0;
+    };
+
+    Closure closure;
+    runtime::DummyContext context;
+    for (bool lhs : {false, true}) {
+        auto rhs = make_unique<CountingStatement>(true);
+        auto& or_rhs = *rhs;
+        Or or_statement{make_unique<BoolConst>(lhs), std::move(rhs)};
+        ASSERT(or_statement.Execute(closure, context).TryAs<runtime::Bool>()->GetValue());
+        ASSERT_EQUAL(or_rhs.executions, lhs ? 0 : 1);
+
+        rhs = make_unique<CountingStatement>(true);
+        auto& and_rhs = *rhs;
+        And and_statement{make_unique<BoolConst>(lhs), std::move(rhs)};
+        auto and_result = and_statement.Execute(closure, context);
+        ASSERT_EQUAL(and_result.TryAs<runtime::Bool>()->GetValue(), lhs);
+        ASSERT_EQUAL(and_rhs.executions, lhs ? 1 : 0);
+    }
+
+    // Невычисленный rhs не может вызвать ошибку, а None в lhs по-прежнему недопустим
+    Or true_or_none{make_unique<BoolConst>(true), make_unique<None>()};
+    ASSERT(true_or_none.Execute(closure, context).TryAs<runtime::Bool>()->GetValue());
+    And false_and_none{make_unique<BoolConst>(false), make_unique<None>()};
+    ASSERT(!false_and_none.Execute(closure, context).TryAs<runtime::Bool>()->GetValue());
+    And true_and_none{make_unique<BoolConst>(true), make_unique<None>()};
+    ASSERT_THROWS(true_and_none.Execute(closure, context), std::runtime_error);
+    Or none_or_true{make_unique<None>(), make_unique<BoolConst>(true)};
+    ASSERT_THROWS(none_or_true.Execute(closure, context), std::runtime_error);
+}
+
 void TestNot() {
     auto test_not = [](bool arg) {
         Not not_statement{make_unique<BoolConst>(arg)};
@@ -453,6 +498,117 @@ void TestNot() {
     test_not(false);
 }
 
+void TestArithmeticsDoesNotAllocate() {
+    runtime::DummyContext context;
+    Closure closure = {{"x"s, ObjectHolder::Own(runtime::Number(6))},
+                       {"y"s, ObjectHolder::Own(runtime::Number(3))}};
+
+    vector<unique_ptr<Statement>> operations;
+    operations.push_back(make_unique<Add>(make_unique<VariableValue>("x"s),
+                                          make_unique<VariableValue>("y"s)));
+    operations.push_back(make_unique<Sub>(make_unique<VariableValue>("x"s),
+                                          make_unique<VariableValue>("y"s)));
+    operations.push_back(make_unique<Mult>(make_unique<VariableValue>("x"s),
+                                           make_unique<VariableValue>("y"s)));
+    operations.push_back(make_unique<Div>(make_unique<VariableValue>("x"s),
+                                          make_unique<VariableValue>("y"s)));
+    operations.push_back(make_unique<Comparison>(runtime::Less, make_unique<VariableValue>("x"s),
+                                                 make_unique<VariableValue>("y"s)));
+    operations.push_back(make_unique<Not>(make_unique<VariableValue>("x"s)));
+
+    vector<ObjectHolder> results(operations.size());
+    const size_t allocations = allocation_counter::CountAllocations([&] {
+        for (size_t i = 0; i < operations.size(); ++i) {
+            results[i] = operations[i]->Execute(closure, context);
+        }
+    });
+    ASSERT_EQUAL(allocations, 0U);
+    ASSERT_OBJECT_VALUE_EQUAL(results[0], 9);
+    ASSERT_OBJECT_VALUE_EQUAL(results[1], 3);
+    ASSERT_OBJECT_VALUE_EQUAL(results[2], 18);
+    ASSERT_OBJECT_VALUE_EQUAL(results[3], 2);
+    ASSERT_OBJECT_VALUE_EQUAL(results[4], "False"s);
+    ASSERT_OBJECT_VALUE_EQUAL(results[5], "False"s);
+}
+
+void TestConstantsDoNotAllocate() {
+    runtime::DummyContext context;
+    Closure closure;
+    NumericConst number(runtime::Number(57));
+    StringConst str(runtime::String("a string long enough to live in the heap"s));
+    BoolConst boolean(runtime::Bool(true));
+    runtime::Class cls("Empty"s, {}, nullptr);
+    NewInstance instance(cls);
+
+    ObjectHolder results[4];
+    const size_t allocations = allocation_counter::CountAllocations([&] {
+        results[0] = number.Execute(closure, context);
+        results[1] = str.Execute(closure, context);
+        results[2] = boolean.Execute(closure, context);
+        results[3] = instance.Execute(closure, context);
+        ObjectHolder copy = results[1];
+    });
+    ASSERT_EQUAL(allocations, 0U);
+    ASSERT_OBJECT_VALUE_EQUAL(results[0], 57);
+    ASSERT_OBJECT_VALUE_EQUAL(results[1], "a string long enough to live in the heap"s);
+    ASSERT_OBJECT_VALUE_EQUAL(results[2], "True"s);
+    ASSERT(results[3].TryAs<runtime::ClassInstance>() != nullptr);
+}
+
+void TestStringifySmallValuesDoesNotAllocate() {
+    runtime::DummyContext context;
+    Closure closure;
+    Stringify small(make_unique<NumericConst>(runtime::SMALL_INT_STRING_MIN));
+    Stringify large(make_unique<NumericConst>(runtime::SMALL_INT_STRING_MAX + 1));
+    Stringify negative(make_unique<NumericConst>(-7));
+    Stringify boolean(make_unique<BoolConst>(runtime::Bool(false)));
+    Stringify none(make_unique<None>());
+    small.Execute(closure, context);
+
+    // Строки малых чисел, True, False и None созданы заранее
+    ObjectHolder results[4];
+    const size_t allocations = allocation_counter::CountAllocations([&] {
+        results[0] = small.Execute(closure, context);
+        results[1] = negative.Execute(closure, context);
+        results[2] = boolean.Execute(closure, context);
+        results[3] = none.Execute(closure, context);
+    });
+    ASSERT_EQUAL(allocations, 0U);
+    ASSERT_OBJECT_VALUE_EQUAL(results[0], to_string(runtime::SMALL_INT_STRING_MIN));
+    ASSERT_OBJECT_VALUE_EQUAL(results[1], "-7"s);
+    ASSERT_OBJECT_VALUE_EQUAL(results[2], "False"s);
+    ASSERT_OBJECT_VALUE_EQUAL(results[3], "None"s);
+
+    ASSERT_OBJECT_VALUE_EQUAL(large.Execute(closure, context),
+                              to_string(runtime::SMALL_INT_STRING_MAX + 1));
+}
+
+void TestReturn() {
+    runtime::DummyContext context;
+    Closure closure;
+
+    // return в середине тела останавливает метод, не выбрасывая исключений
+    auto early_return = make_unique<Compound>(make_unique<Return>(make_unique<VariableValue>("x"s)));
+    MethodBody body{make_unique<Compound>(
+        make_unique<Assignment>("x"s, make_unique<NumericConst>(1)),
+        make_unique<IfElse>(make_unique<BoolConst>(true), std::move(early_return), nullptr),
+        make_unique<Print>(make_unique<StringConst>("unreachable"s)))};
+
+    ObjectHolder result;
+    ASSERT_DOESNT_THROW(result = body.Execute(closure, context));
+    ASSERT_OBJECT_VALUE_EQUAL(result, 1);
+    ASSERT(context.output.str().empty());
+
+    // Без return тело метода возвращает None
+    MethodBody empty{make_unique<Compound>(make_unique<Print>(make_unique<StringConst>("ok"s)))};
+    ASSERT(!empty.Execute(closure, context));
+    ASSERT_EQUAL(context.output.str(), "ok\n"s);
+
+    // Вне тела метода return просто вычисляет своё значение
+    Return ret{make_unique<NumericConst>(7)};
+    ASSERT_OBJECT_VALUE_EQUAL(ret.Execute(closure, context), 7);
+}
+
 }  // namespace
 
 void RunUnitTests(TestRunner& tr) {
@@ -476,6 +632,11 @@ void RunUnitTests(TestRunner& tr) {
     RUN_TEST(tr, ast::TestOr);
     RUN_TEST(tr, ast::TestAnd);
     RUN_TEST(tr, ast::TestNot);
+    RUN_TEST(tr, ast::TestLogicalShortCircuit);
+    RUN_TEST(tr, ast::TestReturn);
+    RUN_TEST(tr, ast::TestArithmeticsDoesNotAllocate);
+    RUN_TEST(tr, ast::TestConstantsDoNotAllocate);
+    RUN_TEST(tr, ast::TestStringifySmallValuesDoesNotAllocate);
 }
 
 }  // namespace ast
\ No newline at end of file
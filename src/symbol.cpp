@@ -0,0 +1,49 @@
+#include "../include/symbol.h"
+
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+using namespace std;
+
+namespace runtime {
+
+Symbol::Symbol() {
+    static const Entry* const empty = Intern({});
+    entry_ = empty;
+}
+
+Symbol::Symbol(string_view name)
+    : entry_(Intern(name)) {
+}
+
+const Symbol::Entry* Symbol::Intern(string_view name) {
+    // Таблица разделена на части со своими мьютексами, чтобы потоки, одновременно
+    // разбирающие программу, не ждали друг друга. Ключи ссылаются на строки, которыми
+    // владеют сами записи. Таблица не разрушается, чтобы символы оставались действительны
+    // и при завершении программы
+    struct Shard {
+        mutex table_mutex;
+        unordered_map<string_view, unique_ptr<Entry>> table;
+    };
+    constexpr size_t SHARD_COUNT = 64;
+    static auto* const shards = new Shard[SHARD_COUNT];
+
+    const size_t hash = std::hash<string_view>{}(name);
+    Shard& shard = shards[(hash >> 16) % SHARD_COUNT];
+    lock_guard guard(shard.table_mutex);
+    auto it = shard.table.find(name);
+    if (it == shard.table.end()) {
+        auto entry = make_unique<Entry>(Entry{string(name), hash});
+        const string_view key = entry->name;
+        it = shard.table.emplace(key, std::move(entry)).first;
+    }
+    return it->second.get();
+}
+
+ostream& operator<<(ostream& os, Symbol symbol) {
+    return os << symbol.GetName();
+}
+
+}  // namespace runtime
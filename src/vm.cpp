@@ -0,0 +1,450 @@
+#include "../include/vm.h"
+
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MYTHON_COMPUTED_GOTO
+#endif
+
+using namespace std;
+
+namespace vm {
+
+using runtime::Closure;
+using runtime::Context;
+using runtime::ObjectHolder;
+
+namespace {
+const string ERROR_OPERATION = "Error: the operation cannot be performed: "s;
+
+std::string JoinDottedIds(const std::vector<runtime::Symbol>& ids) {
+    std::ostringstream imploded;
+    std::copy(ids.begin(), ids.end(), std::ostream_iterator<runtime::Symbol>(imploded, ", "));
+    return imploded.str();
+}
+
+// Значение слота переменной, которой ещё ничего не присвоено.
+// Отличается от None, так как None - допустимое значение переменной
+class Unbound : public runtime::Object {
+public:
+    void Print(std::ostream&, Context&) override {
+    }
+};
+
+Unbound unbound;
+
+const ObjectHolder& UnboundValue() {
+    static const ObjectHolder holder = ObjectHolder::Share(unbound);
+    return holder;
+}
+
+bool IsUnbound(const ObjectHolder& holder) {
+    return holder.Get() == &unbound;
+}
+
+// Заполняет первые count слотов значениями одноимённых переменных closure
+void ImportLocals(const Chunk& chunk, ObjectHolder* R, const Closure& closure, size_t count) {
+    for (size_t slot = 0; slot < chunk.locals.size(); ++slot) {
+        auto it = slot < count ? closure.find(chunk.locals[slot]) : closure.end();
+        R[slot] = it != closure.end() ? it->second : UnboundValue();
+    }
+}
+
+// Записывает в closure значения всех переменных, которым присвоено значение
+void ExportLocals(const Chunk& chunk, const ObjectHolder* R, Closure& closure) {
+    for (size_t slot = 0; slot < chunk.locals.size(); ++slot) {
+        if (!IsUnbound(R[slot])) {
+            ObjectHolder value = R[slot];
+            value.Retain();
+            closure[chunk.locals[slot]] = std::move(value);
+        }
+    }
+}
+
+// Повторяет семантику ast::VariableValue::Execute. Если промежуточное значение
+// не является объектом класса, следующее имя ищется среди локальных переменных
+ObjectHolder LoadChain(const Chunk& chunk, const FieldChain& chain, const ObjectHolder* R) {
+    const auto& ids = chain.ids;
+    auto unknown = [&ids]() {
+        return runtime_error("Uncknown : " + JoinDottedIds(ids));
+    };
+
+    ObjectHolder result = R[chain.slot];
+    if (IsUnbound(result)) {
+        throw unknown();
+    }
+    runtime::FieldTable* fields = nullptr;
+    if (auto* instance = result.TryAs<runtime::ClassInstance>()) {
+        fields = &instance->Fields();
+    }
+    for (size_t i = 1; i < ids.size(); ++i) {
+        if (fields) {
+            auto* value = fields->Find(ids[i], chain.caches[i]);
+            if (!value) {
+                throw unknown();
+            }
+            result = *value;
+        } else {
+            auto it = std::find(chunk.locals.begin(), chunk.locals.end(), ids[i]);
+            if (it == chunk.locals.end() || IsUnbound(R[it - chunk.locals.begin()])) {
+                throw unknown();
+            }
+            result = R[it - chunk.locals.begin()];
+        }
+        if (auto* instance = result.TryAs<runtime::ClassInstance>()) {
+            fields = &instance->Fields();
+        }
+    }
+    return result;
+}
+
+ObjectHolder Add(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+    {
+        auto l = lhs.TryAs<runtime::Number>(), r = rhs.TryAs<runtime::Number>();
+        if (l && r) {
+            return ObjectHolder::Own(runtime::Number(l->GetValue() + r->GetValue()));
+        }
+    }
+    {
+        auto l = lhs.TryAs<runtime::String>(), r = rhs.TryAs<runtime::String>();
+        if (l && r) {
+            return ObjectHolder::Own(runtime::String(l->GetValue() + r->GetValue()));
+        }
+    }
+    if (auto* instance = lhs.TryAs<runtime::ClassInstance>()) {
+        const auto* method = instance->GetClass().GetSpecialMethod(runtime::SpecialMethod::Add);
+        if (method) {
+            ObjectHolder argument = rhs;
+            return instance->Call(method, {&argument, 1}, context);
+        }
+    }
+    throw std::runtime_error(ERROR_OPERATION + "Add"s);
+}
+
+template <typename Operation>
+ObjectHolder NumericOperation(const ObjectHolder& lhs, const ObjectHolder& rhs,
+                              Operation operation, const std::string& name) {
+    auto l = lhs.TryAs<runtime::Number>(), r = rhs.TryAs<runtime::Number>();
+    if (l && r) {
+        return ObjectHolder::Own(runtime::Number(operation(l->GetValue(), r->GetValue())));
+    }
+    throw std::runtime_error(ERROR_OPERATION + name);
+}
+
+ObjectHolder Div(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+    auto r = rhs.TryAs<runtime::Number>();
+    if (r && r->GetValue() == 0) {
+        throw std::runtime_error(ERROR_OPERATION + "Division"s);
+    }
+    return NumericOperation(lhs, rhs, std::divides<int>(), "Division"s);
+}
+
+// Вызов вынесен из цикла исполнения: переход DISPATCH через computed goto
+// не вызывает деструкторы локальных переменных инструкции.
+// Аргументы лежат во временных регистрах и переносятся в кадр вызова без копирования
+ObjectHolder CallMethod(const CallSite& site, const ObjectHolder& receiver, ObjectHolder* R,
+                        Context& context) {
+    auto* instance = receiver.TryAs<runtime::ClassInstance>();
+    // Метод найден инструкцией LookupMethod. Запись могла быть вытеснена,
+    // только если при вычислении аргументов это же место вызвано для других классов
+    const runtime::Method* method = site.cache.Peek(instance->GetClass());
+    if (!method) {
+        method = instance->GetClass().GetMethod(site.method);
+    }
+    return instance->Call(method, {R + site.args, site.argc}, context);
+}
+
+// Исполняет chunk. Если arguments не nullptr, значения первых imported_locals слотов
+// переносятся из arguments, иначе берутся из closure
+ObjectHolder Interpret(const Chunk& chunk, ObjectHolder* arguments, Closure& closure,
+                       Context& context) {
+    runtime::CallFrame frame(chunk.register_count);
+    ObjectHolder* const R = frame.Slots();
+    if (arguments != nullptr) {
+        std::move(arguments, arguments + chunk.imported_locals, R);
+        std::fill(R + chunk.imported_locals, R + chunk.locals.size(), UnboundValue());
+    } else {
+        ImportLocals(chunk, R, closure, chunk.imported_locals);
+    }
+    const Instruction* const code = chunk.code.data();
+    const Instruction* ip = code;
+
+    // Положение ошибки определяется по ip только при её обработке,
+    // поэтому исполнение инструкций не замедляется
+    try {
+#ifdef MYTHON_COMPUTED_GOTO
+    static const void* const dispatch_table[] = {
+#define MYTHON_OPCODE_LABEL(name) &&op_##name,
+        MYTHON_OPCODES(MYTHON_OPCODE_LABEL)
+#undef MYTHON_OPCODE_LABEL
+    };
+#define TARGET(name) op_##name:
+#define DISPATCH() goto* dispatch_table[static_cast<size_t>(ip->op)]
+    DISPATCH();
+#else
+#define TARGET(name) case OpCode::name:
+#define DISPATCH() continue
+    for (;;) {
+        switch (ip->op) {
+#endif
+
+    TARGET(LoadConst) {
+        R[ip->a] = chunk.constants[ip->b];
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(LoadNone) {
+        R[ip->a] = ObjectHolder::None();
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Move) {
+        R[ip->a] = R[ip->b];
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(LoadLocal) {
+        if (IsUnbound(R[ip->b])) {
+            throw runtime_error("Uncknown : " + chunk.locals[ip->b].GetName() + ", ");
+        }
+        R[ip->a] = R[ip->b];
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(LoadDotted) {
+        R[ip->a] = LoadChain(chunk, chunk.chains[ip->b], R);
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(LoadInstance) {
+        R[ip->a] = LoadChain(chunk, chunk.chains[ip->b], R);
+        if (!R[ip->a].TryAs<runtime::ClassInstance>()) {
+            throw runtime_error("Error: is not class"s);
+        }
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(StoreField) {
+        const FieldSite& site = chunk.fields[ip->b];
+        auto& fields = R[ip->a].TryAs<runtime::ClassInstance>()->Fields();
+        R[ip->c].Retain();
+        fields.Emplace(site.name, site.cache) = R[ip->c];
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Add) {
+        R[ip->a] = Add(R[ip->b], R[ip->c], context);
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Sub) {
+        R[ip->a] = NumericOperation(R[ip->b], R[ip->c], std::minus<int>(), "Substruct"s);
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Mult) {
+        R[ip->a] = NumericOperation(R[ip->b], R[ip->c], std::multiplies<int>(), "Multiply"s);
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Div) {
+        R[ip->a] = Div(R[ip->b], R[ip->c]);
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Equal) {
+        R[ip->a] = ObjectHolder::Own(runtime::Bool{runtime::Equal(R[ip->b], R[ip->c], context)});
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(NotEqual) {
+        R[ip->a] = ObjectHolder::Own(runtime::Bool{runtime::NotEqual(R[ip->b], R[ip->c], context)});
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Less) {
+        R[ip->a] = ObjectHolder::Own(runtime::Bool{runtime::Less(R[ip->b], R[ip->c], context)});
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Greater) {
+        R[ip->a] = ObjectHolder::Own(runtime::Bool{runtime::Greater(R[ip->b], R[ip->c], context)});
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(LessOrEqual) {
+        R[ip->a] =
+            ObjectHolder::Own(runtime::Bool{runtime::LessOrEqual(R[ip->b], R[ip->c], context)});
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(GreaterOrEqual) {
+        R[ip->a] =
+            ObjectHolder::Own(runtime::Bool{runtime::GreaterOrEqual(R[ip->b], R[ip->c], context)});
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Compare) {
+        const auto& comparator = chunk.comparators[ip->c];
+        R[ip->a] = ObjectHolder::Own(runtime::Bool{comparator(R[ip->b], R[ip->b + 1], context)});
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Truth) {
+        if (!R[ip->b]) {
+            throw runtime_error("Invalid arguments");
+        }
+        R[ip->a] = ObjectHolder::Own(runtime::Bool{runtime::IsTrue(R[ip->b])});
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Not) {
+        if (!R[ip->b]) {
+            throw runtime_error("Invalid arguments");
+        }
+        R[ip->a] = ObjectHolder::Own(runtime::Bool{!runtime::IsTrue(R[ip->b])});
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Stringify) {
+        R[ip->a] = runtime::Stringify(R[ip->b], context);
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(PrintArg) {
+        auto& output = context.GetOutputStream();
+        if (ip->b != 0) {
+            output << ' ';
+        }
+        if (R[ip->a]) {
+            R[ip->a]->Print(output, context);
+        } else {
+            output << "None";
+        }
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(PrintNewline) {
+        context.GetOutputStream() << '\n';
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(LookupMethod) {
+        const CallSite& site = chunk.calls[ip->c];
+        auto* instance = R[ip->b].TryAs<runtime::ClassInstance>();
+        if (!instance) {
+            throw runtime_error("Error: is not class"s);
+        }
+        if (site.cache.Lookup(instance->GetClass(), site.method, site.argc)) {
+            ++ip;
+        } else {
+            R[ip->a] = ObjectHolder::None();
+            ip = code + site.skip;
+        }
+        DISPATCH();
+    }
+    TARGET(CallMethod) {
+        R[ip->a] = CallMethod(chunk.calls[ip->c], R[ip->b], R, context);
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(ExecuteNode) {
+        // Узел работает с именами, поэтому на время его исполнения closure
+        // становится представлением кадра
+        ExportLocals(chunk, R, closure);
+        R[ip->a] = chunk.nodes[ip->b]->Execute(closure, context);
+        ImportLocals(chunk, R, closure, chunk.locals.size());
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(Jump) {
+        ip = code + ip->a;
+        DISPATCH();
+    }
+    TARGET(JumpIfFalse) {
+        if (runtime::IsTrue(R[ip->a])) {
+            ++ip;
+        } else {
+            ip = code + ip->b;
+        }
+        DISPATCH();
+    }
+    TARGET(JumpIfTrue) {
+        if (runtime::IsTrue(R[ip->a])) {
+            ip = code + ip->b;
+        } else {
+            ++ip;
+        }
+        DISPATCH();
+    }
+    TARGET(Return) {
+        if (chunk.export_locals) {
+            ExportLocals(chunk, R, closure);
+        }
+        return std::move(R[ip->a]);
+    }
+    TARGET(ReturnNone) {
+        if (chunk.export_locals) {
+            ExportLocals(chunk, R, closure);
+        }
+        return ObjectHolder::None();
+    }
+
+#ifndef MYTHON_COMPUTED_GOTO
+        }
+    }
+#endif
+#undef TARGET
+#undef DISPATCH
+    } catch (const ExecutionError&) {
+        // Место уже указано кодом, в котором ошибка возникла
+        throw;
+    } catch (const std::runtime_error& error) {
+        const parse::SourceLocation location = chunk.LocationAt(static_cast<uint32_t>(ip - code));
+        if (!location.IsKnown()) {
+            throw;
+        }
+        throw ExecutionError(error.what(), location);
+    }
+}
+}  // namespace
+
+parse::SourceLocation Chunk::LocationAt(std::uint32_t pc) const {
+    const auto next = std::upper_bound(locations.begin(), locations.end(), pc,
+                                       [](std::uint32_t address, const LocationEntry& entry) {
+                                           return address < entry.pc;
+                                       });
+    return next == locations.begin() ? parse::SourceLocation{} : std::prev(next)->location;
+}
+
+ObjectHolder Run(const Chunk& chunk, Closure& closure, Context& context) {
+    return Interpret(chunk, nullptr, closure, context);
+}
+
+ObjectHolder Run(const Chunk& chunk, ObjectHolder* arguments, Context& context) {
+    // Пустая таблица не выделяет память. Она заполняется, только если в теле есть узлы,
+    // исполняемые по именам
+    Closure closure;
+    return Interpret(chunk, arguments, closure, context);
+}
+
+Code::Code(Chunk chunk, std::unique_ptr<runtime::Executable> source)
+    : chunk_(std::move(chunk)), source_(std::move(source)) {
+}
+
+ObjectHolder Code::Execute(Closure& closure, Context& context) {
+    return Run(chunk_, closure, context);
+}
+
+ObjectHolder Code::Call(const runtime::Method& method, ObjectHolder* frame, Context& context) {
+    // Компилятор отводит self и параметрам первые слоты в том же порядке, что и в кадре.
+    // Если имена параметров повторяются, слотов меньше и кадр передаётся через Closure
+    if (chunk_.imported_locals != method.frame_size) {
+        return Executable::Call(method, frame, context);
+    }
+    return Run(chunk_, frame, context);
+}
+
+}  // namespace vm
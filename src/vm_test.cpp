@@ -0,0 +1,565 @@
+#include "../include/allocation_counter_p.h"
+#include "../include/compiler.h"
+#include "../include/lexer.h"
+#include "../include/parse.h"
+#include "../include/process_memory_p.h"
+#include "../include/statement.h"
+#include "../include/test_runner_p.h"
+
+using namespace std;
+
+namespace vm {
+
+namespace {
+
+unique_ptr<runtime::Executable> ParseProgramFromString(const string& program) {
+    istringstream is(program);
+    parse::Lexer lexer(is);
+    return ParseProgram(lexer);
+}
+
+string RunTree(const string& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    ParseProgramFromString(program)->Execute(closure, context);
+    return context.output.str();
+}
+
+string RunCompiled(const string& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    Compile(ParseProgramFromString(program))->Execute(closure, context);
+    return context.output.str();
+}
+
+// Байткод должен давать в точности тот же вывод, что и обход дерева
+void AssertSameOutput(const string& program, const string& expected) {
+    ASSERT_EQUAL(RunTree(program), expected);
+    ASSERT_EQUAL(RunCompiled(program), expected);
+}
+
+void TestArithmetics() {
+    AssertSameOutput("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2, -(3 - 10)\n"s,
+                     "15 120 -13 3 15 7\n"s);
+}
+
+void TestVariablesAndStrings() {
+    AssertSameOutput(R"(
+x = 57
+y = 'hello, '
+z = y + "world"
+print x, y, z, None, True, False
+x = z
+print x, str(15), str(None), str(x)
+)"s,
+                     "57 hello,  hello, world None True False\nhello, world 15 None hello, world\n"s);
+}
+
+void TestComparisonsAndLogic() {
+    AssertSameOutput(R"(
+a = 1
+b = 2
+print a < b, a > b, a == b, a != b, a <= b, a >= b, 'a' < 'b'
+print a < b and b > a, a > b or b < a, not a == b, not True
+)"s,
+                     "True False False True True False True\nTrue False True False\n"s);
+}
+
+void TestLogicalShortCircuit() {
+    AssertSameOutput(R"(
+class Check:
+  def __init__():
+    self.calls = 0
+
+  def ok(result):
+    self.calls = self.calls + 1
+    return result
+
+c = Check()
+a = c.ok(False) and c.ok(True)
+b = c.ok(True) or c.ok(False)
+print a, b, c.calls
+d = c.ok(True) and c.ok(False)
+e = c.ok(False) or c.ok(True)
+print d, e, c.calls
+print True or None, False and None, 0 or 'x', 1 and ''
+x = 5
+x = x and x + 1
+print x
+)"s,
+                     "False True 2\nFalse True 6\nTrue False True False\nTrue\n"s);
+}
+
+void TestClassesAndRecursion() {
+    AssertSameOutput(R"(
+class GCD:
+  def __init__():
+    self.call_count = 0
+
+  def calc(a, b):
+    self.call_count = self.call_count + 1
+    if a < b:
+      return self.calc(b, a)
+    if b == 0:
+      return a
+    return self.calc(a - b, b)
+
+x = GCD()
+print x.calc(510510, 18629977)
+print x.calc(22, 17)
+print x.call_count
+)"s,
+                     "17\n1\n115\n"s);
+}
+
+void TestPolymorphismAndSpecialMethods() {
+    AssertSameOutput(R"(
+class Shape:
+  def __str__():
+    return "Shape"
+
+  def area():
+    return 0
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.w = w
+    self.h = h
+
+  def area():
+    return self.w * self.h
+
+  def __str__():
+    return "Rect(" + str(self.w) + 'x' + str(self.h) + ')'
+
+  def __eq__(other):
+    return self.area() == other.area()
+
+  def __lt__(other):
+    return self.area() < other.area()
+
+  def __add__(other):
+    return self.area() + other.area()
+
+s = Shape()
+r = Rect(10, 20)
+q = Rect(5, 40)
+print s, r, s.area(), r.area()
+print r == q, r < q, r + q, r.missing(), s.area(1)
+r.w = 1
+print r.w, r, r.area()
+)"s,
+                     "Shape Rect(10x20) 0 200\nTrue False 400 None None\n1 Rect(1x20) 20\n"s);
+}
+
+void TestMethodCallArgumentsAreSkippedWhenMethodIsMissing() {
+    AssertSameOutput(R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def add():
+    self.value = self.value + 1
+    return self.value
+
+c = Counter()
+c.missing(c.add())
+print c.value
+)"s,
+                     "0\n"s);
+}
+
+void TestMethodCallSitesAreCached() {
+    const string program = R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def add(n):
+    if n > 0:
+      self.value = self.value + 1
+      self.add(n - 1)
+
+c = Counter()
+c.add(100)
+print c.value
+)"s;
+    for (bool compiled : {false, true}) {
+        [[maybe_unused]] const runtime::MethodCacheStats before = runtime::MethodCache::Stats();
+        ASSERT_EQUAL(compiled ? RunCompiled(program) : RunTree(program), "100\n"s);
+#ifdef MYTHON_METHOD_CACHE_STATS
+        const auto& after = runtime::MethodCache::Stats();
+        // Каждое место вызова промахивается один раз: c.add и self.add,
+        // а байткод кеширует ещё и вызов __init__. Остальные 99 вызовов self.add - попадания
+        ASSERT_EQUAL(after.misses - before.misses, compiled ? 3U : 2U);
+        ASSERT_EQUAL(after.hits - before.hits, 99U);
+#endif
+    }
+}
+
+void TestRuntimeErrors() {
+    ASSERT_THROWS(RunCompiled("print x\n"s), std::runtime_error);
+    ASSERT_THROWS(RunCompiled("x = 1\nprint x + 'a'\n"s), std::runtime_error);
+    ASSERT_THROWS(RunCompiled("x = 1\nx.y = 2\n"s), std::runtime_error);
+    ASSERT_THROWS(RunCompiled("print 1 / 0\n"s), std::runtime_error);
+}
+
+string RunCompiledWithLocations(const string& program) {
+    istringstream is(program);
+    parse::Lexer lexer(is);
+    parse::SourceMap locations;
+    auto code = Compile(ParseProgram(lexer, locations), &locations);
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    code->Execute(closure, context);
+    return context.output.str();
+}
+
+void TestRuntimeErrorLocations() {
+    auto error_location = [](const string& program) {
+        try {
+            RunCompiledWithLocations(program);
+        } catch (const ExecutionError& e) {
+            return e.GetLocation();
+        }
+        return parse::SourceLocation{};
+    };
+    ASSERT(error_location("x = 1\nprint y\n"s) == (parse::SourceLocation{2, 7}));
+    ASSERT(error_location("x = 1\nprint x + 'a'\n"s) == (parse::SourceLocation{2, 9}));
+    // Ошибка в теле метода указывает на место в методе, а не на место вызова
+    ASSERT(error_location(R"(
+class A:
+  def f(x):
+    return x / 0
+a = A()
+print a.f(1)
+)"s) == (parse::SourceLocation{4, 14}));
+
+    try {
+        RunCompiledWithLocations("print x\n"s);
+        ASSERT(false);
+    } catch (const std::runtime_error& e) {
+        ASSERT_EQUAL(string(e.what()), "line 1, column 7: Uncknown : x, "s);
+    }
+
+    // Без таблицы положений ошибки остаются прежними
+    bool thrown = false;
+    try {
+        RunCompiled("print x\n"s);
+    } catch (const std::runtime_error& e) {
+        thrown = true;
+        ASSERT(dynamic_cast<const ExecutionError*>(&e) == nullptr);
+    }
+    ASSERT(thrown);
+}
+
+string RunIncrementally(const string& program) {
+    istringstream is(program);
+    parse::Lexer lexer(is);
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    ExecuteIncrementally(lexer, closure, context);
+    return context.output.str();
+}
+
+// Исполняет program потоково и проверяет вывод и прирост пиковой памяти
+void AssertStreamingMemoryIsBounded(const string& program, const string& expected_output) {
+    istringstream is(program);
+#ifndef __SANITIZE_ADDRESS__
+    process_memory::ResetPeak();
+    const long rss_before = process_memory::StatusKb("VmRSS:"sv);
+#endif
+    parse::Lexer lexer(is);
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    ExecuteIncrementally(lexer, closure, context);
+    ASSERT_EQUAL(context.output.str(), expected_output);
+#ifndef __SANITIZE_ADDRESS__
+    // Под AddressSanitizer освобождённая память не переиспользуется сразу
+    constexpr long RSS_GROWTH_LIMIT_KB = 8 * 1024;
+    const long peak = process_memory::StatusKb("VmHWM:"sv);
+    if (rss_before >= 0 && peak >= rss_before) {
+        ASSERT(peak - rss_before < RSS_GROWTH_LIMIT_KB);
+    }
+#endif
+}
+
+void TestIncrementalExecution() {
+    // Объекты, константы и классы переживают инструкции, в которых созданы
+    const string program = R"(
+class Holder:
+  def __init__():
+    self.items = None
+
+class Item:
+  def __init__(holder, name):
+    holder.items = self
+    self.name = name
+
+  def __str__():
+    return 'Item ' + self.name
+
+h = Holder()
+item = Item(h, 'first')
+item = None
+x = 'text'
+if x == 'text':
+  y = 2
+print h.items, x, y
+)"s;
+    ASSERT_EQUAL(RunIncrementally(program), RunCompiled(program));
+    ASSERT_EQUAL(RunIncrementally(program), "Item first text 2\n"s);
+    ASSERT_THROWS(RunIncrementally("print 1\nprint y\n"s), std::runtime_error);
+
+    // Память, занимаемая программой, не растёт с её длиной: дерево всей программы
+    // заняло бы десятки мегабайт
+    constexpr size_t STATEMENTS = 200'000;
+    string long_program = "x = 0\n"s;
+    for (size_t i = 0; i < STATEMENTS; ++i) {
+        long_program += "x = x + 1\n"s;
+    }
+    long_program += "print x\n"s;
+    AssertStreamingMemoryIsBounded(long_program, to_string(STATEMENTS) + "\n"s);
+
+    // Объекты, созданные инструкциями, удаляются, когда на них не остаётся ссылок.
+    // Последний объект доступен только через поле, куда записан его self
+    string objects_program = R"(
+class Owner:
+  def __init__():
+    self.last = None
+
+class Node:
+  def __init__(owner, value):
+    owner.last = self
+    self.value = value
+
+owner = Owner()
+)"s;
+    for (size_t i = 0; i < STATEMENTS; ++i) {
+        objects_program += "node = Node(owner, "s + to_string(i) + ")\n"s;
+    }
+    objects_program += "node = None\nprint owner.last.value\n"s;
+    AssertStreamingMemoryIsBounded(objects_program, to_string(STATEMENTS - 1) + "\n"s);
+}
+
+void TestCompactBytecode() {
+    auto program = Compile(ParseProgramFromString("x = 1\ny = x + 1\n"s));
+    const auto& chunk = dynamic_cast<const Code&>(*program).GetChunk();
+
+    // LoadConst LoadConst Add ReturnNone: x и y хранятся в слотах 0 и 1
+    ASSERT_EQUAL(chunk.code.size(), 4U);
+    ASSERT(chunk.code[2].op == OpCode::Add);
+    ASSERT_EQUAL(chunk.code[2].a, 1U);
+    ASSERT_EQUAL(chunk.code[2].b, 0U);
+    ASSERT_EQUAL(chunk.locals, (vector<runtime::Symbol>{"x"s, "y"s}));
+    ASSERT_EQUAL(chunk.register_count, 3U);
+}
+
+void TestLocalsAreResolvedToSlots() {
+    auto program = Compile(ParseProgramFromString(R"(
+class Adder:
+  def add(a, b):
+    result = a + b
+    return result
+
+adder = Adder()
+print adder.add(2, 3)
+)"s));
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "5\n"s);
+    // Локальные переменные метода не попадают в область видимости программы
+    ASSERT_EQUAL(closure.count("result"s), 0U);
+
+    // Переменные, которым заведомо присвоено значение, читаются из слота без проверок
+    auto straight_line = Compile(ParseProgramFromString("a = 1\nb = a\nprint b\n"s));
+    const auto& chunk = dynamic_cast<const Code&>(*straight_line).GetChunk();
+    for (const auto& instruction : chunk.code) {
+        ASSERT(instruction.op != OpCode::LoadLocal && instruction.op != OpCode::ExecuteNode);
+    }
+}
+
+void TestClosureIsAViewOfProgramLocals() {
+    auto program = Compile(ParseProgramFromString("y = x + 1\nz = 'unused'\n"s));
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    closure["x"s] = runtime::ObjectHolder::Own(runtime::Number(41));
+    program->Execute(closure, context);
+    ASSERT_EQUAL(closure.at("y"s).TryAs<runtime::Number>()->GetValue(), 42);
+    ASSERT_EQUAL(closure.at("z"s).TryAs<runtime::String>()->GetValue(), "unused"s);
+    ASSERT_EQUAL(closure.size(), 3U);
+}
+
+void TestConditionallyAssignedLocals() {
+    AssertSameOutput(R"(
+class Sign:
+  def of(n):
+    if n < 0:
+      s = 'minus'
+    else:
+      if n > 0:
+        s = 'plus'
+    return s
+
+sign = Sign()
+print sign.of(-5), sign.of(5)
+)"s,
+                     "minus plus\n"s);
+    ASSERT_THROWS(RunCompiled(R"(
+class Sign:
+  def of(n):
+    if n < 0:
+      s = 'minus'
+    return s
+
+sign = Sign()
+print sign.of(1)
+)"s),
+                  std::runtime_error);
+    ASSERT_THROWS(RunCompiled("print y\ny = 1\n"s), std::runtime_error);
+}
+
+void TestMethodBodiesAreCompiled() {
+    auto program = Compile(ParseProgramFromString(R"(
+class Answer:
+  def get():
+    return 42
+
+a = Answer()
+)"s));
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program->Execute(closure, context);
+
+    const auto* cls = closure.at("Answer"s).TryAs<runtime::Class>();
+    ASSERT(cls != nullptr);
+    ASSERT(dynamic_cast<const ast::MethodBody*>(cls->GetMethod("get"s)->body.get()) != nullptr);
+
+    auto* instance = closure.at("a"s).TryAs<runtime::ClassInstance>();
+    auto result = instance->Call("get"s, {}, context);
+    ASSERT_EQUAL(result.TryAs<runtime::Number>()->GetValue(), 42);
+}
+
+void TestMethodFramesDoNotAllocate() {
+    auto program = Compile(ParseProgramFromString(R"(
+class Counter:
+  def __init__():
+    self.n = 0
+
+  def down():
+    if self.n == 0:
+      return 0
+    self.n = self.n - 1
+    return self.down() + 1
+
+c = Counter()
+)"s));
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program->Execute(closure, context);
+
+    auto* instance = closure.at("c"s).TryAs<runtime::ClassInstance>();
+    const runtime::Method& down = *instance->GetClass().GetMethod("down"s);
+    const vector<runtime::ObjectHolder> no_args;
+    const auto call = [&](int depth) {
+        instance->Fields()["n"s] = runtime::ObjectHolder::Own(runtime::Number(depth));
+        return instance->Call(down, no_args, context).TryAs<runtime::Number>()->GetValue();
+    };
+    ASSERT_EQUAL(call(1000), 1000);
+
+    // Кадры вызовов берутся со стека кадров потока, а не из кучи
+    int result = 0;
+    ASSERT_EQUAL(allocation_counter::CountAllocations([&] { result = call(1000); }), 0U);
+    ASSERT_EQUAL(result, 1000);
+}
+
+void TestMethodArgumentsAreMovedIntoFrame() {
+    auto program = Compile(ParseProgramFromString(R"(
+class Summator:
+  def sum(n, acc):
+    if n == 0:
+      return acc
+    return self.sum(n - 1, acc + n)
+
+s = Summator()
+)"s));
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program->Execute(closure, context);
+
+    auto* instance = closure.at("s"s).TryAs<runtime::ClassInstance>();
+    const runtime::Method* sum = instance->FindMethod("sum"s, 2U);
+    ASSERT(sum != nullptr);
+    ASSERT(instance->FindMethod("sum"s, 1U) == nullptr);
+    const auto call = [&](int n) {
+        runtime::ObjectHolder args[] = {runtime::ObjectHolder::Own(runtime::Number(n)),
+                                        runtime::ObjectHolder::Own(runtime::Number(0))};
+        return instance->Call(sum, {args, 2}, context).TryAs<runtime::Number>()->GetValue();
+    };
+    ASSERT_EQUAL(call(100), 5050);
+
+    // Аргументы вложенных вызовов не копируются в векторы
+    int result = 0;
+    runtime::ObjectHolder args[] = {runtime::ObjectHolder::Own(runtime::Number(100)),
+                                    runtime::ObjectHolder::Own(runtime::Number(0))};
+    ASSERT_EQUAL(allocation_counter::CountAllocations([&] {
+                     result = instance->Call(sum, {args, 2}, context).TryAs<runtime::Number>()->GetValue();
+                 }),
+                 0U);
+    ASSERT_EQUAL(result, 5050);
+}
+
+void TestRepeatedParameterNames() {
+    // Одноимённым параметрам соответствует один слот, и кадр передаётся через Closure
+    AssertSameOutput(R"(
+class Pair:
+  def second(x, x):
+    return x
+
+p = Pair()
+print p.second(1, 2)
+)"s,
+                     "2\n"s);
+}
+
+void TestUnknownNodesFallBackToTree() {
+    struct Marker : runtime::Executable {
+        runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context&) override {
+            closure["marker"s] = runtime::ObjectHolder::Own(runtime::Number(1));
+            return {};
+        }
+    };
+    auto program = Compile(make_unique<Marker>());
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program->Execute(closure, context);
+    ASSERT_EQUAL(closure.count("marker"s), 1U);
+}
+
+}  // namespace
+
+void RunVmTests(TestRunner& tr) {
+    RUN_TEST(tr, vm::TestArithmetics);
+    RUN_TEST(tr, vm::TestVariablesAndStrings);
+    RUN_TEST(tr, vm::TestComparisonsAndLogic);
+    RUN_TEST(tr, vm::TestLogicalShortCircuit);
+    RUN_TEST(tr, vm::TestClassesAndRecursion);
+    RUN_TEST(tr, vm::TestPolymorphismAndSpecialMethods);
+    RUN_TEST(tr, vm::TestMethodCallArgumentsAreSkippedWhenMethodIsMissing);
+    RUN_TEST(tr, vm::TestMethodCallSitesAreCached);
+    RUN_TEST(tr, vm::TestRuntimeErrors);
+    RUN_TEST(tr, vm::TestRuntimeErrorLocations);
+    RUN_TEST(tr, vm::TestIncrementalExecution);
+    RUN_TEST(tr, vm::TestCompactBytecode);
+    RUN_TEST(tr, vm::TestLocalsAreResolvedToSlots);
+    RUN_TEST(tr, vm::TestClosureIsAViewOfProgramLocals);
+    RUN_TEST(tr, vm::TestConditionallyAssignedLocals);
+    RUN_TEST(tr, vm::TestMethodBodiesAreCompiled);
+    RUN_TEST(tr, vm::TestMethodFramesDoNotAllocate);
+    RUN_TEST(tr, vm::TestMethodArgumentsAreMovedIntoFrame);
+    RUN_TEST(tr, vm::TestRepeatedParameterNames);
+    RUN_TEST(tr, vm::TestUnknownNodesFallBackToTree);
+}
+
+}  // namespace vm